@@ -19,6 +19,10 @@ extern int32_t ece391_open (const uint8_t* filename);
 extern int32_t ece391_close (int32_t fd);
 extern int32_t ece391_getargs (uint8_t* buf, int32_t nbytes);
 extern int32_t ece391_vidmap (uint8_t** screen_start);
+/* nanoseconds since boot */
+extern int32_t ece391_gettime (uint64_t* ns);
+/* block for at least ms milliseconds */
+extern int32_t ece391_sleep (uint32_t ms);
 
 #endif /* ECE391SYSCALL_H */
 
@@ -0,0 +1,77 @@
+#ifndef _ELF_H
+#define _ELF_H
+
+#include "types.h"
+
+#define EI_NIDENT       16
+
+/* e_ident fields */
+#define EI_CLASS        4
+#define EI_DATA         5
+#define ELFCLASS32      1
+#define ELFDATA2LSB     1
+
+#define ET_EXEC         2
+#define EM_386          3
+
+/* program header types and flags */
+#define PT_LOAD         1
+#define ELF_PF_X        0x1
+#define ELF_PF_W        0x2
+#define ELF_PF_R        0x4
+
+/* program headers read per executable, and PT_LOAD segments kept */
+#define ELF_MAX_PHDRS   8
+#define PROG_MAX_SEGS   4
+
+/* ELF file header */
+typedef struct elf32_ehdr {
+    uint8_t  e_ident[EI_NIDENT];
+    uint16_t e_type;
+    uint16_t e_machine;
+    uint32_t e_version;
+    uint32_t e_entry;
+    uint32_t e_phoff;
+    uint32_t e_shoff;
+    uint32_t e_flags;
+    uint16_t e_ehsize;
+    uint16_t e_phentsize;
+    uint16_t e_phnum;
+    uint16_t e_shentsize;
+    uint16_t e_shnum;
+    uint16_t e_shstrndx;
+} elf32_ehdr_t;
+
+/* ELF program header */
+typedef struct elf32_phdr {
+    uint32_t p_type;
+    uint32_t p_offset;
+    uint32_t p_vaddr;
+    uint32_t p_paddr;
+    uint32_t p_filesz;
+    uint32_t p_memsz;
+    uint32_t p_flags;
+    uint32_t p_align;
+} elf32_phdr_t;
+
+/* a PT_LOAD segment: filesz bytes from offset at vaddr, then zeros up to memsz */
+typedef struct prog_segment {
+    uint32_t vaddr;
+    uint32_t memsz;
+    uint32_t offset;
+    uint32_t filesz;
+    /* ELF_PF_* */
+    uint32_t flags;
+} prog_segment_t;
+
+/* what execute needs to know about an executable */
+typedef struct program_info {
+    uint32_t inode;
+    /* file size in bytes */
+    uint32_t size;
+    uint32_t entry;
+    uint32_t seg_count;
+    prog_segment_t segs[PROG_MAX_SEGS];
+} program_info_t;
+
+#endif
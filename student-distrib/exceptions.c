@@ -2,6 +2,8 @@
 #include "exceptions.h"
 #include "system_call.h"
 #include "process.h"
+#include "paging.h"
+#include "file_system.h"
 
 #define PAGE_FAULT  14
 
@@ -85,3 +87,48 @@ void exception_handler(int exp_id) {
     );
     */
 }
+
+/*  
+ * page_fault_handler
+ *   DESCRIPTION: resolve a fault in the running program's 128MB-132MB
+ *                region: a not-present page is filled from the executable
+ *                (demand paging), a write to a shared image page is copied
+ *   INPUTS: error_code -- error code pushed by the CPU
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 if the page was filled and the access can be retried
+ *                 -1 if the fault is a real exception
+ *   SIDE EFFECTS: maps a program page; the first user-mode fault after
+ *                 execute stops the exec-to-first-instruction clock
+ */
+int32_t page_fault_handler(uint32_t error_code) {
+    uint32_t fault_addr;
+    asm volatile
+    ("movl %%cr2, %0"
+        :"=r"(fault_addr)
+        :
+    );
+
+    /* only the program region is ours to fill */
+    if (!prog_counter)
+        return -1;
+    if (fault_addr < PROGRAM_PAGE_VIRTUAL_ADDR || fault_addr >= PROGRAM_PAGE_VIRTUAL_ADDR + FOUR_MB)
+        return -1;
+
+    /* find current process's pcb */
+    pcb_t* cur_pcb = current;
+
+    /* a write to a shared image page gets a private copy */
+    if (error_code & PF_PRESENT) {
+        if (!(error_code & PF_WRITE))
+            return -1;
+        return program_cow_page(cur_pcb, fault_addr);
+    }
+
+    if (program_fill_page(cur_pcb, fault_addr) == -1)
+        return -1;
+
+    /* the first user fault is the fetch of the entry instruction */
+    if (error_code & PF_USER)
+        exec_timing_stop(cur_pcb);
+    return 0;
+}
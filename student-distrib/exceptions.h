@@ -2,8 +2,12 @@
 #ifndef _EXP_H
 #define _EXP_H
 
+#include "types.h"
+
 /* handle an exception */
 #define EXP_NUM     0x20
 extern void exception_handler(int exp_id);
+/* try to resolve a page fault, 0 if the access can be retried */
+extern int32_t page_fault_handler(uint32_t error_code);
 
 #endif
@@ -2,8 +2,9 @@
 #include "types.h"
 #include "file_system.h"
 #include "process.h"
+#include "paging.h"
+#include "image_cache.h"
 
-#define PROGRAM_DIRECTORY_VIRTUAL_ADDR  0x08048000
 const char EXEC_HEAD[4] = {0x7f, 0x45, 0x4c, 0x46};
 
 uint32_t file_system_addr = 0;
@@ -13,6 +14,65 @@ uint32_t block_num = 0;
 
 #define MAGIC_NUM_LENGTH    4
 
+/* the boot block holds at most 63 dentries (4KB / 64B, minus the statistics) */
+#define DENTRY_MAX          63
+/* power of two and at least twice DENTRY_MAX to keep probe chains short */
+#define DENTRY_HASH_SIZE    128
+#define DENTRY_HASH_MASK    (DENTRY_HASH_SIZE - 1)
+#define FNV_OFFSET_BASIS    2166136261U
+#define FNV_PRIME           16777619U
+
+/* dentry index + 1 for each bucket, 0 marks an empty bucket */
+static uint8_t dentry_hash[DENTRY_HASH_SIZE];
+
+fs_stats_t fs_stats;
+
+/* bounded per-inode extent maps, replaced least-recently-used first */
+static extent_map_t extent_cache[EXTENT_CACHE_SIZE];
+static uint32_t extent_clock = 0;
+
+/*  
+ * hash_file_name
+ *   DESCRIPTION: FNV-1a hash of a file name, stopping at NUL or after
+ *                NAME_LENGTH_MAX bytes so that 32-byte names without a
+ *                terminator hash the same as their user-supplied form
+ *   INPUTS: name -- file name
+ *   OUTPUTS: none
+ *   RETURN VALUE: 32-bit hash
+ *   SIDE EFFECTS: none
+ */
+static uint32_t hash_file_name(const uint8_t* name) {
+    uint32_t hash = FNV_OFFSET_BASIS;
+    uint32_t i;
+    for (i = 0; i < NAME_LENGTH_MAX && name[i] != '\0'; i++) {
+        hash ^= name[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+/*  
+ * build_dentry_hash
+ *   DESCRIPTION: index every dentry of the boot block by file name
+ *                (open addressing with linear probing)
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: fills dentry_hash
+ */
+static void build_dentry_hash() {
+    uint32_t dentry_idx, bucket;
+    dentry_t* dentry_addr = (dentry_t *)file_system_addr + 1;
+
+    memset(dentry_hash, 0, sizeof(dentry_hash));
+    for (dentry_idx = 0; dentry_idx < dentry_num && dentry_idx < DENTRY_MAX; dentry_idx++) {
+        bucket = hash_file_name(dentry_addr[dentry_idx].file_name) & DENTRY_HASH_MASK;
+        while (dentry_hash[bucket])
+            bucket = (bucket + 1) & DENTRY_HASH_MASK;
+        dentry_hash[bucket] = dentry_idx + 1;
+    }
+}
+
 /*  
  * print_file_names
  *   DESCRIPTION: early-stage test function to print file names
@@ -51,36 +111,50 @@ void init_file_system(uint32_t fs_addr) {
     inode_num = * ((uint32_t *)file_system_addr + 1);
     block_num = * ((uint32_t *)file_system_addr + 2);
 
+    build_dentry_hash();
+    extent_cache_flush();
+    memset(&fs_stats, 0, sizeof(fs_stats));
+
     file_array = NULL;
 }
 
 /*  
  * read_dentry_by_name
  *   DESCRIPTION: fill up the input dentry corresponding to fname
- *                search through boot block and check for fname
+ *                look fname up in the dentry hash built at init time
  *   INPUTS: fname -- file name we search for
  *           dentry -- input struct that we would like to update
  *   OUTPUTS: none
  *   RETURN VALUE: 0 if successful
  *                 -1 if not successful
- *   SIDE EFFECTS: none
+ *   SIDE EFFECTS: updates the lookup counters in fs_stats
  */
 int32_t read_dentry_by_name(const uint8_t* fname, dentry_t* dentry) {
     if (fname == NULL || dentry == NULL || strlen((int8_t*)fname) > 32)
         return -1;
-    uint32_t dentry_idx = 0;
-    dentry_t* dentry_addr = (dentry_t *)file_system_addr;
-
-    /* search through boot block for a dentry with the input fname */
-    for (dentry_idx = 0; dentry_idx < dentry_num; dentry_idx ++) {
-        dentry_addr++;
-
+    uint64_t start = rdtsc();
+    int32_t ret = -1;
+    uint32_t bucket = hash_file_name(fname) & DENTRY_HASH_MASK;
+    dentry_t* dentry_addr;
+
+    /* probe until an empty bucket ends the chain */
+    while (dentry_hash[bucket]) {
+        fs_stats.lookup_probes++;
+        dentry_addr = (dentry_t *)file_system_addr + dentry_hash[bucket];
         if (!strncmp((int8_t *)fname, (int8_t *)dentry_addr->file_name, NAME_LENGTH_MAX)) {
             *dentry = *dentry_addr;
-            return 0;
-        } 
+            ret = 0;
+            break;
+        }
+        bucket = (bucket + 1) & DENTRY_HASH_MASK;
     }
-    return -1;
+
+    fs_stats.lookup_last_cycles = (uint32_t)(rdtsc() - start);
+    fs_stats.lookup_cycles += fs_stats.lookup_last_cycles;
+    fs_stats.lookups++;
+    if (ret)
+        fs_stats.lookup_misses++;
+    return ret;
 }
 
 /*  
@@ -126,10 +200,103 @@ int32_t get_file_size(dentry_t * dentry) {
 }
 
 
+/*  
+ * extent_map_build
+ *   DESCRIPTION: describe an inode's data blocks as runs of consecutive
+ *                block indices, stopping once EXTENTS_PER_INODE runs are used
+ *                (blocks past the last run are resolved from the inode)
+ *   INPUTS: inode -- inode index, must be valid
+ *   OUTPUTS: none
+ *   RETURN VALUE: the filled extent map
+ *   SIDE EFFECTS: may evict the least recently used map
+ */
+static extent_map_t* extent_map_build(uint32_t inode) {
+    inode_t* inode_struct = ((inode_t*)file_system_addr + inode + 1);
+    extent_map_t* map = &extent_cache[0];
+    extent_t* run = NULL;
+    uint32_t i, block_count, block_idx;
+
+    /* take a free slot, otherwise the least recently used one */
+    for (i = 0; i < EXTENT_CACHE_SIZE; i++) {
+        if (!extent_cache[i].valid) {
+            map = &extent_cache[i];
+            break;
+        }
+        if (extent_cache[i].last_used < map->last_used)
+            map = &extent_cache[i];
+    }
+    if (map->valid)
+        fs_stats.extent_evictions++;
+
+    block_count = (inode_struct->length + DATA_LENGTH - 1) / DATA_LENGTH;
+    if (block_count > VALID_BLOCK)
+        block_count = VALID_BLOCK;
+
+    map->count = 0;
+    for (i = 0; i < block_count; i++) {
+        block_idx = inode_struct->block_idx[i];
+        if (block_idx >= block_num)
+            break;
+        /* extend the current run if this block follows it on disk */
+        if (run && run->physical + run->length == block_idx) {
+            run->length++;
+            continue;
+        }
+        if (map->count == EXTENTS_PER_INODE)
+            break;
+        run = &map->extents[map->count++];
+        run->logical = i;
+        run->physical = block_idx;
+        run->length = 1;
+    }
+
+    map->inode = inode;
+    map->valid = 1;
+    map->last_used = ++extent_clock;
+    fs_stats.extent_builds++;
+    return map;
+}
+
+/*  
+ * extent_map_get
+ *   DESCRIPTION: find the cached extent map of an inode, building it on a miss
+ *   INPUTS: inode -- inode index, must be valid
+ *   OUTPUTS: none
+ *   RETURN VALUE: the extent map
+ *   SIDE EFFECTS: updates the extent cache counters in fs_stats
+ */
+static extent_map_t* extent_map_get(uint32_t inode) {
+    uint32_t i;
+    for (i = 0; i < EXTENT_CACHE_SIZE; i++) {
+        if (extent_cache[i].valid && extent_cache[i].inode == inode) {
+            fs_stats.extent_hits++;
+            extent_cache[i].last_used = ++extent_clock;
+            return &extent_cache[i];
+        }
+    }
+    fs_stats.extent_misses++;
+    return extent_map_build(inode);
+}
+
+/*  
+ * extent_cache_flush
+ *   DESCRIPTION: drop every cached extent map
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: the next read of each inode rebuilds its map
+ */
+void extent_cache_flush() {
+    memset(extent_cache, 0, sizeof(extent_cache));
+}
+
 /*  
  * read_data
  *   DESCRIPTION: reading up to 'length' bytes of data from file system into buf
  *                data range: [offset, offset + length), may be in discrete data blocks
+ *                the range is clamped at the end of the file, then each run of
+ *                consecutive data blocks from the inode's extent map is copied
+ *                with a single memcpy
  *   INPUTS: inode -- inode index
  *           offset -- the offset for the starting byte
  *           buf -- input struct that we would like to fill
@@ -138,7 +305,7 @@ int32_t get_file_size(dentry_t * dentry) {
  *   RETURN VALUE: number of bytes successful read
  *                 0 if we reach the end of the inode
  *                 -1 if not successful
- *   SIDE EFFECTS: none
+ *   SIDE EFFECTS: builds the inode's extent map if it is not cached
  */
 int32_t read_data(uint32_t inode, uint32_t offset, uint8_t* buf, int32_t length) {
     // Check if the given inode is in the valid range
@@ -149,48 +316,230 @@ int32_t read_data(uint32_t inode, uint32_t offset, uint8_t* buf, int32_t length)
     // Find the current inode struct
     inode_t* inode_struct = ((inode_t*)file_system_addr + inode + 1);
 
-    uint32_t i;
-
-    /*********** IMPORTANT ***********/
-    /* If return earlier, also return the number of bytes read*/
-    // i: index of byte in current inode's data
-    for (i = offset; i < (offset + length); i++) {
-        // Calculate the pointer to the current data struct
-        uint32_t block_idx = *(inode_struct->block_idx + i / DATA_LENGTH);
-
-        // Check if the block idx is in the valid range
-        if (block_idx >= block_num) {
-            return i - offset - 1;
+    /* clamp the request at the end of the file */
+    if (offset >= inode_struct->length)
+        return 0;
+    if ((uint32_t)length > inode_struct->length - offset)
+        length = inode_struct->length - offset;
+
+    extent_map_t* map = extent_map_get(inode);
+    extent_t* run;
+    uint32_t ext = 0;
+    /* logical block of the first byte and the offset inside that block */
+    uint32_t block_pos = offset / DATA_LENGTH;
+    uint32_t block_offset = offset % DATA_LENGTH;
+    uint32_t block_idx, run_blocks, span;
+    int32_t bytes_read = 0;
+
+    while (bytes_read < length) {
+        /* runs are sorted, so skip forward to the one holding block_pos */
+        while (ext < map->count && block_pos >= map->extents[ext].logical + map->extents[ext].length)
+            ext++;
+
+        if (ext < map->count) {
+            run = &map->extents[ext];
+            block_idx = run->physical + (block_pos - run->logical);
+            run_blocks = run->logical + run->length - block_pos;
+        } else {
+            /* past the cached runs: resolve one block from the inode */
+            if (block_pos >= VALID_BLOCK)
+                break;
+            block_idx = inode_struct->block_idx[block_pos];
+            // Check if the block idx is in the valid range
+            if (block_idx >= block_num)
+                break;
+            run_blocks = 1;
+            fs_stats.extent_walk_blocks++;
         }
 
+        /* consecutive data blocks are adjacent in memory: copy the run at once */
+        span = run_blocks * DATA_LENGTH - block_offset;
+        if (span > (uint32_t)(length - bytes_read))
+            span = length - bytes_read;
+
         data_block_t* data_struct = ((data_block_t*)file_system_addr + 1 + inode_num + block_idx);
-        *(buf++) = *(data_struct->data + i % DATA_LENGTH);
+        memcpy(buf + bytes_read, data_struct->data + block_offset, span);
 
-        // If we reach the end of the inode 
-        if (i == (inode_struct->length)){
-            return i - offset;
-        }
+        bytes_read += span;
+        block_pos += run_blocks;
+        block_offset = 0;
     }
-    return i - offset;
+
+    /* a bad block index before any byte was copied is an error */
+    if (bytes_read == 0 && length > 0)
+        return -1;
+    return bytes_read;
 }
 
 /*  
  * program_loader
- *   DESCRIPTION: load a program into memory (virtual addr 128MB-132MB page)
- *   INPUTS: prog_dentry -- the program we want to load
+ *   DESCRIPTION: load a program into memory (virtual addr 128MB-132MB page).
+ *                File pages come from the image cache when the executable
+ *                fits in it. With demand_paging set only the page table is
+ *                reset and each page is filled on its first fault; otherwise
+ *                each PT_LOAD segment is filled up front (stack and other
+ *                pages outside the segments are still zero-filled on fault)
+ *   INPUTS: info -- the program we want to load, from check_validity
+ *           pcb -- pcb of the process the image belongs to
  *   OUTPUTS: none
  *   RETURN VALUE: 0 if successful
  *                 -1 if not
- *   SIDE EFFECTS: none
+ *   SIDE EFFECTS: records the image in pcb and pins it in the image cache,
+ *                 rewrites pcb's program page table
+ */
+int32_t program_loader(program_info_t* info, pcb_t* pcb) {
+    uint32_t vaddr, i;
+    prog_segment_t* seg;
+    tlb_batch_t batch;
+
+    pcb->exec = *info;
+    pcb->exec_image = image_cache_get(info->inode, info->size);
+    tlb_batch_init(&batch);
+    clear_program_pages(pcb->prog_table, &batch);
+    tlb_batch_flush(&batch);
+    if (demand_paging)
+        return 0;
+
+    for (i = 0; i < info->seg_count; i++) {
+        seg = &info->segs[i];
+        for (vaddr = seg->vaddr & PAGE_MASK; vaddr < seg->vaddr + seg->memsz; vaddr += PAGE_SIZE) {
+            if (program_fill_page(pcb, vaddr) == -1)
+                return -1;
+        }
+    }
+    return 0;
+}
+
+/*  
+ * program_shared_frame
+ *   DESCRIPTION: find the image cache frame that can back a program page
+ *                directly: the page must lie in a single segment, at the
+ *                same page offset as in the file, and be read-only or
+ *                hold file bytes only (no bss)
+ *   INPUTS: pcb -- pcb of the faulting process
+ *           page -- page-aligned address
+ *           cow -- set to 1 if the segment is writable
+ *   OUTPUTS: none
+ *   RETURN VALUE: kernel address of the frame, 0 if the page must be private
+ *   SIDE EFFECTS: may fill an image cache frame
+ */
+static uint32_t program_shared_frame(pcb_t* pcb, uint32_t page, uint32_t* cow) {
+    prog_segment_t* seg = NULL;
+    uint32_t i, file_pos;
+
+    if (pcb->exec_image == NULL)
+        return 0;
+    for (i = 0; i < pcb->exec.seg_count; i++) {
+        prog_segment_t* cur = &pcb->exec.segs[i];
+        if (page + PAGE_SIZE <= cur->vaddr || page >= cur->vaddr + cur->memsz)
+            continue;
+        if (seg != NULL)
+            return 0;
+        seg = cur;
+    }
+    if (seg == NULL || (seg->offset - seg->vaddr) % PAGE_SIZE)
+        return 0;
+
+    *cow = (seg->flags & ELF_PF_W) ? 1 : 0;
+    /* bss must read as zero, so a page reaching past the file bytes stays private */
+    if (page + PAGE_SIZE > seg->vaddr + seg->filesz && (*cow || seg->filesz != seg->memsz))
+        return 0;
+    /* writable bytes before the segment must not be the file's */
+    if (*cow && page < seg->vaddr)
+        return 0;
+
+    /* offset and vaddr agree modulo the page size, so this is page aligned */
+    file_pos = seg->offset + page - seg->vaddr;
+    return image_cache_page(pcb->exec_image, file_pos / PAGE_SIZE);
+}
+
+/*  
+ * program_fill_page
+ *   DESCRIPTION: back the program page holding vaddr. Pages of a cached
+ *                image are mapped shared (read-only text, copy-on-write
+ *                data); anything else gets the process's own frame with the
+ *                file bytes of every segment in the page copied in and the
+ *                rest (bss, stack) zeroed. Pages covered only by read-only
+ *                segments are mapped read-only
+ *   INPUTS: pcb -- pcb of the faulting process
+ *           vaddr -- faulting address, inside 128MB-132MB
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 if successful
+ *                 -1 if not
+ *   SIDE EFFECTS: maps one program page and invalidates its tlb entry
  */
-int32_t program_loader(dentry_t* prog_dentry) {
-    int length = get_file_size(prog_dentry);
-    if (length == -1)
+int32_t program_fill_page(pcb_t* pcb, uint32_t vaddr) {
+    uint32_t page = vaddr & PAGE_MASK;
+    uint32_t frame, cow, i, start, end;
+    uint32_t r_w = 1, in_segment = 0;
+    prog_segment_t* seg;
+    if (page < PROGRAM_PAGE_VIRTUAL_ADDR || page >= PROGRAM_PAGE_VIRTUAL_ADDR + FOUR_MB)
         return -1;
 
-    if (read_data(prog_dentry->inode_idx, 0, (uint8_t*)PROGRAM_DIRECTORY_VIRTUAL_ADDR, length) != 0)
+    if ((frame = program_shared_frame(pcb, page, &cow)) != 0) {
+        map_shared_page(pcb->prog_table, page, frame, cow);
+        flush_tlb_page(page);
+        image_stats.shared_maps++;
+        return 0;
+    }
+
+    if (map_program_page(pcb->prog_table, page, 1) == -1)
         return -1;
+    flush_tlb_page(page);
+    image_stats.private_pages++;
+    memset((void*)page, 0, PAGE_SIZE);
+
+    for (i = 0; i < pcb->exec.seg_count; i++) {
+        seg = &pcb->exec.segs[i];
+        if (page + PAGE_SIZE <= seg->vaddr || page >= seg->vaddr + seg->memsz)
+            continue;
+        if (!in_segment)
+            r_w = 0;
+        in_segment = 1;
+        if (seg->flags & ELF_PF_W)
+            r_w = 1;
+
+        /* copy the part of the segment's file bytes that falls in this page */
+        start = (seg->vaddr > page) ? seg->vaddr : page;
+        end = seg->vaddr + seg->filesz;
+        if (end > page + PAGE_SIZE)
+            end = page + PAGE_SIZE;
+        if (start < end && read_data(pcb->exec.inode, seg->offset + start - seg->vaddr,
+                                     (uint8_t*)start, end - start) != end - start)
+            return -1;
+    }
 
+    if (!r_w) {
+        map_program_page(pcb->prog_table, page, 0);
+        flush_tlb_page(page);
+    }
+    return 0;
+}
+
+/*  
+ * program_cow_page
+ *   DESCRIPTION: give a process its own copy of a shared data page it is
+ *                writing to
+ *   INPUTS: pcb -- pcb of the faulting process
+ *           vaddr -- faulting address, inside 128MB-132MB
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 if successful
+ *                 -1 if the page is not a copy-on-write page (e.g. text)
+ *   SIDE EFFECTS: remaps one program page and invalidates its tlb entry
+ */
+int32_t program_cow_page(pcb_t* pcb, uint32_t vaddr) {
+    uint32_t page = vaddr & PAGE_MASK;
+    uint32_t frame = is_shared_page(pcb->prog_table, page);
+    if (!frame || !is_cow_page(pcb->prog_table, page))
+        return -1;
+
+    /* the shared frame stays reachable through the kernel's identity map */
+    if (map_program_page(pcb->prog_table, page, 1) == -1)
+        return -1;
+    flush_tlb_page(page);
+    memcpy((void*)page, (void*)frame, PAGE_SIZE);
+    image_stats.cow_copies++;
+    image_stats.private_pages++;
     return 0;
 }
 
@@ -230,26 +579,72 @@ void parse_command(const uint8_t* command, uint8_t* filename, uint8_t* params){
 
 /*  
  * check_validity
- *   DESCRIPTION: helper function that check if prog_dentry corresponds to a valid executable
+ *   DESCRIPTION: helper function that check if prog_dentry corresponds to a valid
+ *                executable: a 32-bit little-endian i386 ELF executable whose
+ *                PT_LOAD segments and entry point lie in 128MB-132MB
  *   INPUTS: prog_dentry -- program directory entry that we want to check
+ *           info -- filled with the entry point and PT_LOAD segments
  *   OUTPUTS: none
  *   RETURN VALUE: 0 if valid
  *                 -1 if not
  *   SIDE EFFECTS: none
  */
-int32_t check_validity(dentry_t* prog_dentry) {
+int32_t check_validity(dentry_t* prog_dentry, program_info_t* info) {
+    elf32_ehdr_t ehdr;
+    elf32_phdr_t phdrs[ELF_MAX_PHDRS];
+    int32_t size, phdr_bytes;
+    uint32_t i;
+
     /* check file type */
     if (prog_dentry->file_type != 2) {  // 2 is regular file type
         return -1;
     }
 
     /* check magic header */
-    uint8_t magic_buf[MAGIC_NUM_LENGTH];
-    read_data(prog_dentry->inode_idx, 0, magic_buf, MAGIC_NUM_LENGTH);
-    if (strncmp((int8_t*)magic_buf, (int8_t*)EXEC_HEAD, MAGIC_NUM_LENGTH) != 0)
+    size = get_file_size(prog_dentry);
+    if (read_data(prog_dentry->inode_idx, 0, (uint8_t*)&ehdr, sizeof(ehdr)) != sizeof(ehdr))
+        return -1;
+    if (strncmp((int8_t*)ehdr.e_ident, (int8_t*)EXEC_HEAD, MAGIC_NUM_LENGTH) != 0)
+        return -1;
+    if (ehdr.e_ident[EI_CLASS] != ELFCLASS32 || ehdr.e_ident[EI_DATA] != ELFDATA2LSB ||
+        ehdr.e_type != ET_EXEC || ehdr.e_machine != EM_386 ||
+        ehdr.e_phentsize != sizeof(elf32_phdr_t) || ehdr.e_phnum == 0 || ehdr.e_phnum > ELF_MAX_PHDRS)
         return -1;
 
-    return 0;
+    phdr_bytes = ehdr.e_phnum * sizeof(elf32_phdr_t);
+    if (read_data(prog_dentry->inode_idx, ehdr.e_phoff, (uint8_t*)phdrs, phdr_bytes) != phdr_bytes)
+        return -1;
+
+    info->inode = prog_dentry->inode_idx;
+    info->size = size;
+    info->entry = ehdr.e_entry;
+    info->seg_count = 0;
+    for (i = 0; i < ehdr.e_phnum; i++) {
+        elf32_phdr_t* phdr = &phdrs[i];
+        if (phdr->p_type != PT_LOAD || phdr->p_memsz == 0)
+            continue;
+        if (info->seg_count == PROG_MAX_SEGS || phdr->p_filesz > phdr->p_memsz ||
+            phdr->p_offset > (uint32_t)size || phdr->p_filesz > size - phdr->p_offset ||
+            phdr->p_vaddr < PROGRAM_PAGE_VIRTUAL_ADDR || phdr->p_vaddr >= PROGRAM_PAGE_VIRTUAL_ADDR + FOUR_MB ||
+            phdr->p_memsz > PROGRAM_PAGE_VIRTUAL_ADDR + FOUR_MB - phdr->p_vaddr)
+            return -1;
+        info->segs[info->seg_count].vaddr = phdr->p_vaddr;
+        info->segs[info->seg_count].memsz = phdr->p_memsz;
+        info->segs[info->seg_count].offset = phdr->p_offset;
+        info->segs[info->seg_count].filesz = phdr->p_filesz;
+        info->segs[info->seg_count].flags = phdr->p_flags;
+        info->seg_count++;
+    }
+    if (info->seg_count == 0)
+        return -1;
+
+    /* the entry point has to be in an executable segment */
+    for (i = 0; i < info->seg_count; i++) {
+        prog_segment_t* seg = &info->segs[i];
+        if ((seg->flags & ELF_PF_X) && info->entry >= seg->vaddr && info->entry < seg->vaddr + seg->memsz)
+            return 0;
+    }
+    return -1;
 }
 
 /*  
@@ -264,6 +659,9 @@ int32_t check_validity(dentry_t* prog_dentry) {
 int32_t file_open(int32_t fd) {
     /* fill in file abstraction entry */
     file_array[fd].file_position = 0;
+    /* build the extent map now so reads start with a cache hit */
+    if (file_array[fd].inode_idx < inode_num)
+        extent_map_get(file_array[fd].inode_idx);
     return 0;
 }
 
@@ -313,7 +711,7 @@ int32_t file_read(int32_t fd, void* buf, int32_t nbytes) {
     /* increment file position if we have not reached the end of the file */
     /******* IMPORTANT !!! *********/
     /* Update the file position by actual bytes read instead of nbytes*/
-    if (ret_val)
+    if (ret_val > 0)
         file_array[fd].file_position += ret_val;
 
     return ret_val;
@@ -409,6 +807,25 @@ int32_t directory_write(int32_t fd, const void* buf, int32_t nbytes) {
     return -1;
 }
 
+/*  
+ * print_fs_stats
+ *   DESCRIPTION: dump the file system counters
+ *   INPUTS: none
+ *   OUTPUTS: counters printed to the screen
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void print_fs_stats() {
+    uint32_t avg = fs_stats.lookups ?
+        (uint32_t)div_u64_u32(fs_stats.lookup_cycles, fs_stats.lookups, NULL) : 0;
+    printf("dentry lookups: %u (%u misses, %u probes)\n",
+        fs_stats.lookups, fs_stats.lookup_misses, fs_stats.lookup_probes);
+    printf("lookup cycles: last %u, avg %u\n", fs_stats.lookup_last_cycles, avg);
+    printf("extent cache: %u hits, %u misses, %u builds, %u evictions, %u uncached blocks\n",
+        fs_stats.extent_hits, fs_stats.extent_misses, fs_stats.extent_builds,
+        fs_stats.extent_evictions, fs_stats.extent_walk_blocks);
+}
+
 /*  
  * file_op_init
  *   DESCRIPTION: initiate operation pointer in kernel
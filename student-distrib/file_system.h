@@ -11,6 +11,10 @@
 
 #define FILE_LIMIT      8
 
+/* inodes with a cached extent map, and runs kept per inode */
+#define EXTENT_CACHE_SIZE   16
+#define EXTENTS_PER_INODE   16
+
 typedef struct dentry{
     uint8_t file_name[NAME_LENGTH_MAX];
     uint32_t file_type;
@@ -27,6 +31,53 @@ typedef struct data_block{
     uint8_t data[DATA_LENGTH];
 } data_block_t;
 
+/* a run of consecutive data blocks */
+typedef struct extent {
+    /* first logical block of the run */
+    uint32_t logical;
+    /* data block index of that logical block */
+    uint32_t physical;
+    /* number of blocks in the run */
+    uint32_t length;
+} extent_t;
+
+/* cached extent map of one inode */
+typedef struct extent_map {
+    uint32_t inode;
+    uint32_t valid;
+    /* extents in use, sorted by logical block */
+    uint32_t count;
+    /* LRU stamp */
+    uint32_t last_used;
+    extent_t extents[EXTENTS_PER_INODE];
+} extent_map_t;
+
+/* file system counters, see print_fs_stats */
+typedef struct fs_stats {
+    /* read_dentry_by_name calls and failed lookups */
+    uint32_t lookups;
+    uint32_t lookup_misses;
+    /* hash buckets compared against fname */
+    uint32_t lookup_probes;
+    /* TSC cycles spent in read_dentry_by_name */
+    uint32_t lookup_last_cycles;
+    uint64_t lookup_cycles;
+    /* read_data/file_open extent map lookups */
+    uint32_t extent_hits;
+    uint32_t extent_misses;
+    uint32_t extent_builds;
+    uint32_t extent_evictions;
+    /* blocks read past the end of a full extent map */
+    uint32_t extent_walk_blocks;
+} fs_stats_t;
+
+extern fs_stats_t fs_stats;
+
+/* file system layout read from the boot block */
+extern uint32_t file_system_addr;
+extern uint32_t dentry_num;
+extern uint32_t inode_num;
+extern uint32_t block_num;
 
 /* test function to print file names */
 void print_file_names();
@@ -38,6 +89,11 @@ int32_t read_dentry_by_name(const uint8_t* fname, dentry_t* dentry);
 /* fill up the input dentry corresponding to the dentry index */
 int32_t read_dentry_by_index(uint32_t index, dentry_t* dentry);
 
+/* dump the file system counters */
+void print_fs_stats();
+/* drop every cached extent map */
+void extent_cache_flush();
+
 /* get the file size */
 int32_t get_file_size(dentry_t * dentry);
 /* reading up to 'length' bytes of data from file system into buf */
@@ -45,8 +101,10 @@ int32_t read_data(uint32_t inode, uint32_t offset, uint8_t* buf, int32_t length)
 
 /* helper funtions for syscall execute */
 void parse_command(const uint8_t* command, uint8_t* filename, uint8_t* params);
-int32_t program_loader(dentry_t* prog_dentry);
-int32_t check_validity(dentry_t* prog_dentry);
+int32_t program_loader(program_info_t* info, pcb_t* pcb);
+int32_t program_fill_page(pcb_t* pcb, uint32_t vaddr);
+int32_t program_cow_page(pcb_t* pcb, uint32_t vaddr);
+int32_t check_validity(dentry_t* prog_dentry, program_info_t* info);
 
 /* set up the file abstraction struct when we open a file */
 int32_t file_open(int32_t fd);
@@ -0,0 +1,202 @@
+#include "lib.h"
+#include "types.h"
+#include "image_cache.h"
+#include "file_system.h"
+#include "paging.h"
+#include "page_alloc.h"
+
+image_stats_t image_stats;
+
+static image_t image_cache[IMAGE_CACHE_SIZE];
+static uint32_t image_clock = 0;
+
+/*  
+ * image_release
+ *   DESCRIPTION: return an idle image's frames to the page allocator and
+ *                free its slot
+ *   INPUTS: image -- image with no users
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: frees frames
+ */
+static void image_release(image_t* image) {
+    uint32_t i;
+    for (i = 0; i < image->page_count; i++) {
+        if (image->frames[i]) {
+            page_free(image->frames[i], 0);
+            image_stats.pool_used--;
+        }
+        image->frames[i] = 0;
+    }
+    image->valid = 0;
+}
+
+/*  
+ * image_evict
+ *   DESCRIPTION: drop the least recently used image that no process is running
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: the freed slot, NULL if every image is pinned
+ *   SIDE EFFECTS: frees frames
+ */
+static image_t* image_evict() {
+    image_t* victim = NULL;
+    uint32_t i;
+    for (i = 0; i < IMAGE_CACHE_SIZE; i++) {
+        if (!image_cache[i].valid || image_cache[i].users)
+            continue;
+        if (victim == NULL || image_cache[i].last_used < victim->last_used)
+            victim = &image_cache[i];
+    }
+    if (victim != NULL) {
+        image_release(victim);
+        image_stats.evictions++;
+    }
+    return victim;
+}
+
+/*  
+ * image_frame_alloc
+ *   DESCRIPTION: take a frame from the page allocator, evicting idle images
+ *                if the cache is at its IMAGE_POOL_PAGES budget or memory
+ *                is short
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: address of the frame, 0 if no frame can be freed
+ *   SIDE EFFECTS: may evict images
+ */
+static uint32_t image_frame_alloc() {
+    uint32_t frame;
+    do {
+        if (image_stats.pool_used < IMAGE_POOL_PAGES && (frame = page_alloc(0)) != 0) {
+            image_stats.pool_used++;
+            return frame;
+        }
+    } while (image_evict() != NULL);
+    return 0;
+}
+
+/*  
+ * image_cache_get
+ *   DESCRIPTION: find the cached image of an executable, or claim a slot for
+ *                it; file pages are not read until image_cache_page asks
+ *   INPUTS: inode -- inode of the executable
+ *           size -- file size in bytes
+ *   OUTPUTS: none
+ *   RETURN VALUE: pinned image, NULL if the executable cannot be cached
+ *   SIDE EFFECTS: may evict an idle image
+ */
+image_t* image_cache_get(uint32_t inode, uint32_t size) {
+    image_t* image;
+    uint32_t i;
+
+    for (i = 0; i < IMAGE_CACHE_SIZE; i++) {
+        image = &image_cache[i];
+        if (image->valid && image->inode == inode) {
+            image->users++;
+            image->last_used = ++image_clock;
+            image_stats.hits++;
+            return image;
+        }
+    }
+
+    image_stats.misses++;
+    if ((size + PAGE_SIZE - 1) / PAGE_SIZE > IMAGE_MAX_PAGES) {
+        image_stats.uncacheable++;
+        return NULL;
+    }
+    for (i = 0; i < IMAGE_CACHE_SIZE && image_cache[i].valid; i++);
+    if (i < IMAGE_CACHE_SIZE)
+        image = &image_cache[i];
+    else if ((image = image_evict()) == NULL) {
+        image_stats.uncacheable++;
+        return NULL;
+    }
+    image->inode = inode;
+    image->size = size;
+    image->page_count = (size + PAGE_SIZE - 1) / PAGE_SIZE;
+    memset(image->frames, 0, sizeof(image->frames));
+    image->users = 1;
+    image->last_used = ++image_clock;
+    image->valid = 1;
+    return image;
+}
+
+/*  
+ * image_cache_put
+ *   DESCRIPTION: unpin an image; it stays cached until evicted
+ *   INPUTS: image -- image from image_cache_get, may be NULL
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void image_cache_put(image_t* image) {
+    if (image != NULL && image->users)
+        image->users--;
+}
+
+/*  
+ * image_cache_page
+ *   DESCRIPTION: get the frame holding one file page of an image, reading
+ *                it from the file system the first time; the tail of the
+ *                last page is zero
+ *   INPUTS: image -- pinned image
+ *           page_idx -- file offset / 4KB
+ *   OUTPUTS: none
+ *   RETURN VALUE: kernel (identity mapped) address of the frame, 0 on failure
+ *   SIDE EFFECTS: may take a frame
+ */
+uint32_t image_cache_page(image_t* image, uint32_t page_idx) {
+    uint32_t frame;
+    uint8_t* page;
+
+    if (page_idx >= image->page_count)
+        return 0;
+    if (image->frames[page_idx])
+        return image->frames[page_idx];
+
+    if ((frame = image_frame_alloc()) == 0)
+        return 0;
+    page = (uint8_t*)frame;
+    memset(page, 0, PAGE_SIZE);
+    if (read_data(image->inode, page_idx * PAGE_SIZE, page, PAGE_SIZE) == -1) {
+        page_free(frame, 0);
+        image_stats.pool_used--;
+        return 0;
+    }
+    image->frames[page_idx] = frame;
+    image_stats.page_fills++;
+    return (uint32_t)page;
+}
+
+/*  
+ * image_cache_flush
+ *   DESCRIPTION: drop every image that no process is running
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: frees frames
+ */
+void image_cache_flush() {
+    uint32_t i;
+    for (i = 0; i < IMAGE_CACHE_SIZE; i++) {
+        if (image_cache[i].valid && !image_cache[i].users)
+            image_release(&image_cache[i]);
+    }
+}
+
+/*  
+ * print_image_stats
+ *   DESCRIPTION: print image cache counters
+ *   INPUTS: none
+ *   OUTPUTS: counters to the screen
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void print_image_stats() {
+    printf("image: %d hits, %d misses, %d evictions, %d uncached\n",
+           image_stats.hits, image_stats.misses, image_stats.evictions, image_stats.uncacheable);
+    printf("pages: %d filled, %d shared, %d cow, %d private, pool %d/%d\n",
+           image_stats.page_fills, image_stats.shared_maps, image_stats.cow_copies,
+           image_stats.private_pages, image_stats.pool_used, IMAGE_POOL_PAGES);
+}
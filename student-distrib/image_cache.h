@@ -0,0 +1,61 @@
+#ifndef _IMAGE_CACHE_H
+#define _IMAGE_CACHE_H
+
+#include "types.h"
+
+/* executables kept loaded at once */
+#define IMAGE_CACHE_SIZE    8
+/* largest executable cached, in 4KB pages (larger ones load privately) */
+#define IMAGE_MAX_PAGES     32
+/* 4KB frames from the page allocator all cached images may hold together */
+#define IMAGE_POOL_PAGES    128
+
+/* a loaded executable, its file pages are filled on first use */
+typedef struct image {
+    uint32_t inode;
+    /* file size in bytes */
+    uint32_t size;
+    uint32_t valid;
+    /* processes currently running this image, pinned while non-zero */
+    uint32_t users;
+    /* image clock value of the last get, for LRU replacement */
+    uint32_t last_used;
+    uint32_t page_count;
+    /* frame holding each file page, 0 until the page is filled */
+    uint32_t frames[IMAGE_MAX_PAGES];
+} image_t;
+
+typedef struct image_stats {
+    /* execs that found / did not find their image cached */
+    uint32_t hits;
+    uint32_t misses;
+    /* idle images dropped to make room */
+    uint32_t evictions;
+    /* execs that ran without the cache (too large or cache pinned) */
+    uint32_t uncacheable;
+    /* file pages read into frames */
+    uint32_t page_fills;
+    /* file pages mapped shared from the cache */
+    uint32_t shared_maps;
+    /* shared pages copied on a write */
+    uint32_t cow_copies;
+    /* pages backed by a process's own frame */
+    uint32_t private_pages;
+    /* frames held by cached images */
+    uint32_t pool_used;
+} image_stats_t;
+
+extern image_stats_t image_stats;
+
+/* find or create the cached image of an executable, pinning it */
+image_t* image_cache_get(uint32_t inode, uint32_t size);
+/* unpin an image when its process halts */
+void image_cache_put(image_t* image);
+/* kernel address of a file page of an image, filling it if needed */
+uint32_t image_cache_page(image_t* image, uint32_t page_idx);
+/* drop every idle image */
+void image_cache_flush();
+/* print image cache counters */
+void print_image_stats();
+
+#endif
@@ -16,6 +16,9 @@
 #include "system_call.h"
 #include "process.h"
 #include "scheduling.h"
+#include "page_alloc.h"
+#include "ktime.h"
+#include "timer.h"
 
 #define RUN_TESTS   0
 /* Macros. */
@@ -71,6 +74,8 @@ void entry(unsigned long magic, unsigned long addr) {
                 printf("0x%x ", *((char*)(mod->mod_start+i)));
             }
             printf("\n");
+            /* the file system image must not become free frames */
+            page_alloc_reserve(mod->mod_start, mod->mod_end);
             mod_count++;
             mod++;
         }
@@ -96,7 +101,7 @@ void entry(unsigned long magic, unsigned long addr) {
                 (unsigned)mbi->mmap_addr, (unsigned)mbi->mmap_length);
         for (mmap = (memory_map_t *)mbi->mmap_addr;
                 (unsigned long)mmap < mbi->mmap_addr + mbi->mmap_length;
-                mmap = (memory_map_t *)((unsigned long)mmap + mmap->size + sizeof (mmap->size)))
+                mmap = (memory_map_t *)((unsigned long)mmap + mmap->size + sizeof (mmap->size))) {
             printf("    size = 0x%x, base_addr = 0x%#x%#x\n    type = 0x%x,  length    = 0x%#x%#x\n",
                     (unsigned)mmap->size,
                     (unsigned)mmap->base_addr_high,
@@ -104,6 +109,14 @@ void entry(unsigned long magic, unsigned long addr) {
                     (unsigned)mmap->type,
                     (unsigned)mmap->length_high,
                     (unsigned)mmap->length_low);
+            /* type 1 is usable RAM; the page allocator only reaches below 4GB */
+            if (mmap->type == 1 && mmap->base_addr_high == 0) {
+                uint32_t end = mmap->base_addr_low + mmap->length_low;
+                if (mmap->length_high || end < mmap->base_addr_low)
+                    end = 0xFFFFF000;
+                page_alloc_add_region(mmap->base_addr_low, end);
+            }
+        }
     }
 
     /* Construct an LDT entry in the GDT */
@@ -157,10 +170,12 @@ void entry(unsigned long magic, unsigned long addr) {
     /* Init the PIC */
     i8259_init();
 
+    /* calibrate the TSC against the PIT, the clock starts here */
+    ktime_init();
+
     /* Initialize devices and interrupts */
-    enable_irq(1);  // rtc is on 1
-    rtc_init();
-    enable_irq(8);  // keyboard is on 8
+    enable_irq(1);  // keyboard is on 1
+    rtc_init();     // rtc (irq 8) is unmasked once an rtc is opened
 
     /* initialize cursor */
     enable_cursor();
@@ -179,7 +194,8 @@ void entry(unsigned long magic, unsigned long addr) {
     /* initialize 3 terminals */
     init_terminals();
 
-    /* initialize pit*/
+    /* initialize pit and the timers it drives */
+    timer_init();
     pit_init();
     enable_irq(0);
 
@@ -73,54 +73,38 @@ void keyboard_handler(){
         return;
     }
 
-    /* terminal_read is executing*/
-    if(terminal0.TERMINAL_READ_FLAG){
-        /* if ctl+l is pressed, clear keyboard buffer */
-        if (ascii_char == CTRL_L) {
-            terminal0.buf_index = 0;
-            send_eoi(KEYBOARD_PIC);
-            return;
-        }
-        /* if ENTER is pressed, signal terminal_read to continue */
-        /* store in buffer and echo to screen */
-        if(ascii_char == NEW_LINE) {
-            /* signal terminal_read */
-            terminal0.TERMINAL_READ_FLAG = 0;
-            terminal0.keyboard_buf[terminal0.buf_index] = ascii_char;
-            printf_direct("%c", ascii_char);
-            terminal0.buf_index++;
-            send_eoi(KEYBOARD_PIC);
-            return;
-        }
-        /* if TAB is pressed, push 4 SPACE to buffer unless reach the end */
-        /* store in buffer and echo to screen */
-        int tab_counter = 0;
-        while (terminal0.buf_index < KB_BUF_SIZE-1 && ascii_char == TAB && tab_counter < TAB_SPACE) {
-            terminal0.keyboard_buf[terminal0.buf_index] = ' ';
-            terminal0.buf_index++;
-            printf_direct("%c", ' ');
-            tab_counter++;
-        }
-        /* if other key is pressed, store in buffer and echo to screen*/
-        if(terminal0.buf_index < KB_BUF_SIZE-1 && ascii_char != TAB){
-            terminal0.keyboard_buf[terminal0.buf_index] = ascii_char;
-            terminal0.buf_index++;
+    /* if ctl+l is pressed, drop the line being edited */
+    if (ascii_char == CTRL_L) {
+        terminal0.buf_index = 0;
+        send_eoi(KEYBOARD_PIC);
+        return;
+    }
+    /* if ENTER is pressed, queue the line for terminal_read and wake it.
+     * Lines queue up whether or not anyone is reading yet (typeahead)
+     */
+    if (ascii_char == NEW_LINE) {
+        /* no room: keep the line being edited, ENTER can be pressed again */
+        if (terminal_put_line(active_term_idx, terminal0.keyboard_buf, terminal0.buf_index) == 0) {
             printf_direct("%c", ascii_char);
+            terminal0.buf_index = 0;
         }
+        send_eoi(KEYBOARD_PIC);
+        return;
     }
-    /* terminal_read is not executing, simply echo char to screen */
-    else{
-        if (ascii_char == CTRL_L) {
-            send_eoi(KEYBOARD_PIC);
-            return;
-        }
-        int tab_counter = 0;
-        while (ascii_char == TAB && tab_counter < TAB_SPACE) {
-            printf_direct("%c", ' ');
-            tab_counter++;
-        }
-        if (ascii_char != TAB)
-            printf_direct("%c", ascii_char);
+    /* if TAB is pressed, push 4 SPACE to buffer unless reach the end */
+    /* store in buffer and echo to screen */
+    int tab_counter = 0;
+    while (terminal0.buf_index < KB_BUF_SIZE-1 && ascii_char == TAB && tab_counter < TAB_SPACE) {
+        terminal0.keyboard_buf[terminal0.buf_index] = ' ';
+        terminal0.buf_index++;
+        printf_direct("%c", ' ');
+        tab_counter++;
+    }
+    /* if other key is pressed, store in buffer and echo to screen*/
+    if(terminal0.buf_index < KB_BUF_SIZE-1 && ascii_char != TAB){
+        terminal0.keyboard_buf[terminal0.buf_index] = ascii_char;
+        terminal0.buf_index++;
+        printf_direct("%c", ascii_char);
     }
     send_eoi(KEYBOARD_PIC);
 }
@@ -222,12 +206,10 @@ char scancode_handler(unsigned char scancode) {
 
     /* check BACKSPACE pressed */
     if (scancode == BACKSPACE) {
-        if (terminal0.TERMINAL_READ_FLAG) {
-            if (terminal0.buf_index == 0)
-                return -1;
-            else
-                terminal0.buf_index--;
-        }
+        /* only erase what belongs to the line being edited */
+        if (terminal0.buf_index == 0)
+            return -1;
+        terminal0.buf_index--;
         backspace();
     }
     /* check ENTER pressed */
@@ -273,44 +255,85 @@ int32_t terminal_open(int32_t fd){
     return 0;
 }
 
+/* 
+ * terminal_put_line
+ *   DESCRIPTION: queue one completed line for the reader of a terminal and
+ *                wake it. This is the producer side of kb_ring, so it must
+ *                only run from the keyboard interrupt or with interrupts off
+ *   INPUTS: term: index of the terminal
+ *           line: characters of the line, without the '\n'
+ *           len: # of characters in line
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 if the ring has no room for the line
+ *                 (nothing is queued then)
+ *   SIDE EFFECTS: advances the terminal's kb_head, counts kb_overruns
+ */
+int32_t terminal_put_line(int32_t term, const char* line, int32_t len){
+    terminal_t* t = &terminals[term];
+    uint32_t head = t->kb_head;
+    int32_t i;
+
+    /* the line and its '\n' must fit in the free part of the ring */
+    if (len < 0 || KB_RING_SIZE - (head - t->kb_tail) < (uint32_t)len + 1) {
+        t->kb_overruns++;
+        return -1;
+    }
+    for (i = 0; i < len; i++)
+        t->kb_ring[(head + i) & KB_RING_MASK] = line[i];
+    t->kb_ring[(head + len) & KB_RING_MASK] = '\n';
+    /* publish the bytes before the new head */
+    barrier();
+    t->kb_head = head + len + 1;
+    wake_up(&t->read_wait);
+    return 0;
+}
+
 /* 
  * terminal_read
- *   DESCRIPTION: read from the terminal. Keystroke will be stored into keyboard
- *                buffer and echo on the screen. Reading terminates when caller 
- *                presses ENTER. the maximum # of bytes read is 128 and the last
- *                byte is '\n'. Caller needs to allocate space for buf
+ *   DESCRIPTION: read one line from the terminal. Keystrokes are echoed and
+ *                edited by the keyboard interrupt, which queues the line when
+ *                ENTER is pressed, so lines typed ahead of the read are
+ *                returned in order. Blocks until a line is available.
+ *                At most nbytes are returned and the last byte is '\n', the
+ *                rest of a longer line is dropped. Caller needs to allocate
+ *                space for buf
  *   INPUTS: buf: destination of character reading. Must be at least nbytes large
  *        nbytes: # of bytes read from terminal
- *   OUTPUTS: echoes for keystroke
+ *   OUTPUTS: none
  *   RETURN VALUE: # of elements read (including '\n')
- *   SIDE EFFECTS: arg buf is filled. Keyboard buffer is cleared.
+ *   SIDE EFFECTS: arg buf is filled. The line is removed from kb_ring.
  */
 int32_t terminal_read(int32_t fd, char* buf, int32_t nbytes){
     if (buf == 0 || nbytes < 0 || fd != 0)
         return -1;
+    if (nbytes == 0)
+        return 0;
     fd = fd;
-    int32_t i;
+    int32_t count = 0;
+    uint32_t tail;
+    char c;
 
-    /* signal interrupt handler to store char into buffer */
-    terminals[cur_term_id].TERMINAL_READ_FLAG = 1;
-    /* clear keyboard buffer */
-    terminals[cur_term_id].buf_index = 0;
-    /* wait until interrupt handler clear TERMINAL_READ_FLAG
-     * i.e. ENTER is pressed by user
-     */
+    terminal_t* term = &terminals[cur_term_id];
 
-    /* cur_term_id -> running process change 10ms */
-    sti();
-    while (terminals[cur_term_id].TERMINAL_READ_FLAG);
-    cli();
-    /* copy from keyboard buffer to caller's buffer*/
-    int32_t loop_end = (nbytes < (int32_t)terminals[cur_term_id].buf_index) ? 
-        nbytes : (int32_t)terminals[cur_term_id].buf_index;
-    for(i = 0; i < loop_end - 1; i++)
-        buf[i] = terminals[cur_term_id].keyboard_buf[i];
+    /* sleep until the keyboard interrupt has queued a line; the ring itself
+     * needs no masking, only the sleep does
+     */
+    if (term->kb_head == term->kb_tail)
+        wait_event(&term->read_wait, term->kb_head != term->kb_tail);
+    /* the head is only advanced past whole lines, so a '\n' is coming */
+    tail = term->kb_tail;
+    barrier();
+    while ((c = term->kb_ring[tail & KB_RING_MASK]) != NEW_LINE) {
+        if (count < nbytes - 1)
+            buf[count++] = c;
+        tail++;
+    }
     /* terminate the copy with newline character */
-    buf[loop_end - 1] = '\n';
-    return loop_end;
+    buf[count++] = NEW_LINE;
+    /* finish reading the line before handing its bytes back to the producer */
+    barrier();
+    term->kb_tail = tail + 1;
+    return count;
 }
 
 /* 
@@ -320,7 +343,7 @@ int32_t terminal_read(int32_t fd, char* buf, int32_t nbytes){
  *        nbytes: # of bytes written to terminal
  *   OUTPUTS: characters displayed on terminal
  *   RETURN VALUE: # of bytes on success
- *   SIDE EFFECTS: none
+ *   SIDE EFFECTS: the cursor moves once, after the whole buffer is shown
  */
 int32_t terminal_write(int32_t fd, char* buf, int32_t nbytes) {
     /* failure: invalid buf */
@@ -328,14 +351,8 @@ int32_t terminal_write(int32_t fd, char* buf, int32_t nbytes) {
         return -1;
     }
 
-    /* iterate over char in buf and put it on screen */
-    int32_t idx;
-    for (idx = 0; idx < nbytes; idx++){
-        //If nbytes is bigger than len(buf)
-        if (!buf[idx]) continue;
-        // display
-        putc(buf[idx]);
-    }
+    /* put the whole buffer on screen, NUL bytes are skipped */
+    write_screen(cur_term_id, buf, nbytes);
     return nbytes;
 }
 
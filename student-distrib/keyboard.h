@@ -3,6 +3,7 @@
 
 #include "process.h"
 #include "lib.h"
+#include "waitqueue.h"
 
 #define KEYBOARD_DATA   0x60
 #define KEYBOARD_CMD    0x64
@@ -12,11 +13,13 @@
 #define NEW_LINE        0x0A
 
 #define KB_BUF_SIZE 128
+/* typed-ahead lines kept per terminal, a power of two */
+#define KB_RING_SIZE    1024
+#define KB_RING_MASK    (KB_RING_SIZE - 1)
 #define CTRL_L      -2
 #define CTRL_C      -3
 
 #define MAX_TERMINAL_NUM 3
-#define MAX_PROG_NUM_PER_TERM 4
 
 #define terminal0       terminals[active_term_idx]
 
@@ -34,22 +37,39 @@ char scancode_handler(unsigned char scancode);
 typedef struct terminal
 {   
     int32_t active;
-    /* store user's keystrokes to the terminal */
+    /* the line the user is editing, ENTER moves it into kb_ring */
     char keyboard_buf[KB_BUF_SIZE];
     /* track the position of latest char in the buffer */
     int buf_index;
+    /* completed lines, each ending in '\n', waiting for terminal_read.
+       A single-producer single-consumer ring: only the keyboard interrupt
+       moves kb_head and only terminal_read moves kb_tail, so neither side
+       masks interrupts to use it. Both count up freely, used bytes are
+       kb_head - kb_tail */
+    char kb_ring[KB_RING_SIZE];
+    volatile uint32_t kb_head;
+    volatile uint32_t kb_tail;
+    /* lines refused because kb_ring had no room, they stay in keyboard_buf */
+    uint32_t kb_overruns;
     /* store cursor position */
     int32_t cursor_x;
     int32_t cursor_y;
-    /* pids of running programs for this terminal */
-    int32_t prog_pids[MAX_PROG_NUM_PER_TERM];
+    /* pid of the newest program of this terminal, older ones via parent_pcb_pointer */
+    int32_t top_pid;
     /* number of running programs for this terminal */
     int32_t term_prog_counter;
-    /* whether the terminal is reading from keystrokes */
-    volatile int32_t TERMINAL_READ_FLAG;
+    /* terminal_read sleeps here until kb_ring holds a line */
+    wait_queue_t read_wait;
+    /* row of the RAM screen (screen_page) holding the top line, scrolling
+       advances it */
+    int32_t top_row;
+    /* processes of this terminal using vidmap, which need a linear screen */
+    int32_t vidmap_users;
     
 } terminal_t;
 
+/* queue a completed line for terminal term's reader, producer side only */
+int32_t terminal_put_line(int32_t term, const char* line, int32_t len);
 /* open a terminal (do nothing) */
 int32_t terminal_open(int32_t fd);
 /* read from a terminal, update buf (max size 128) */
@@ -0,0 +1,176 @@
+#include "ktime.h"
+#include "lib.h"
+#include "paging.h"
+#include "process.h"
+#include "scheduling.h"
+
+#define PIT_CH2_PORT        0x42
+#define PIT_CMD_PORT        0x43
+#define PIT_GATE_PORT       0x61
+#define PIT_CH2_ONESHOT     0xB0    /* channel 2, lobyte/hibyte, mode 0 */
+#define PIT_CH2_OUT         0x20
+#define PIT_HZ              1193182
+#define CALIBRATE_MS        10
+
+#define NS_PER_MS           1000000
+
+/* user pages, where gettime may write */
+#define MB_128 0x08000000
+#define MB_132 0x08400000
+
+/* the rest of the page stays zero, user code sees nothing else of the kernel */
+static uint8_t time_page_mem[PAGE_SIZE] __attribute__((aligned(PAGE_SIZE)));
+#define time_page   ((time_page_t*)time_page_mem)
+
+/* 
+ * time_page_begin
+ *   DESCRIPTION: start a time page update, readers retry until it ends.
+ *                Interrupts must be off
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: makes seq odd
+ */
+static inline void time_page_begin() {
+    time_page->seq++;
+    barrier();
+}
+
+/* 
+ * time_page_end
+ *   DESCRIPTION: finish a time page update
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: makes seq even again
+ */
+static inline void time_page_end() {
+    barrier();
+    time_page->seq++;
+}
+
+/* 
+ * ktime_init
+ *   DESCRIPTION: calibrate the time-stamp counter against a 10ms one-shot
+ *                on PIT channel 2, and start the clock at 0
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: reprograms PIT channel 2 (speaker stays off),
+ *                 busy-waits 10ms, sets tsc_khz, tsc_mult and tsc_base
+ *                 and publishes them in the time page
+ */
+void ktime_init() {
+    uint32_t count = PIT_HZ / 1000 * CALIBRATE_MS;
+    uint64_t start, end;
+
+    /* raise the channel 2 gate with the speaker disconnected */
+    outb((inb(PIT_GATE_PORT) & ~0x02) | 0x01, PIT_GATE_PORT);
+    outb(PIT_CH2_ONESHOT, PIT_CMD_PORT);
+    outb(count & 0xFF, PIT_CH2_PORT);
+    outb((count >> 8) & 0xFF, PIT_CH2_PORT);
+
+    start = rdtsc();
+    while (!(inb(PIT_GATE_PORT) & PIT_CH2_OUT));
+    end = rdtsc();
+
+    tsc_khz = (uint32_t)div_u64_u32(end - start, CALIBRATE_MS, NULL);
+    /* ns per cycle is 10^6 / khz */
+    tsc_mult = (uint32_t)div_u64_u32((uint64_t)NS_PER_MS << TSC_SHIFT, tsc_khz, NULL);
+    tsc_base = end;
+
+    time_page_begin();
+    time_page->tsc_khz = tsc_khz;
+    time_page->tsc_mult = tsc_mult;
+    time_page->tsc_shift = TSC_SHIFT;
+    time_page->tsc_base = tsc_base;
+    time_page->tick_hz = PIT_HZ / PIT_FREQ;
+    time_page_end();
+}
+
+/* 
+ * time_page_frame
+ *   DESCRIPTION: get the page user processes see at TIME_PAGE_VIRTUAL_ADDR
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: address of the time page, physical and virtual alike
+ *   SIDE EFFECTS: none
+ */
+uint8_t* time_page_frame() {
+    return time_page_mem;
+}
+
+/* 
+ * time_page_tick
+ *   DESCRIPTION: count a PIT tick in the time page, called by pit_handler
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: updates ticks, tick_ns and running
+ */
+void time_page_tick() {
+    time_page_begin();
+    time_page->ticks++;
+    time_page->tick_ns = ktime_ns();
+    time_page->running = prog_counter;
+    time_page_end();
+}
+
+/* 
+ * time_page_switch
+ *   DESCRIPTION: count a process switch in the time page
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: updates switches
+ */
+void time_page_switch() {
+    time_page_begin();
+    time_page->switches++;
+    time_page_end();
+}
+
+/* 
+ * cycles_to_ns
+ *   DESCRIPTION: convert a TSC cycle count to nanoseconds with one
+ *                multiply and shift, split in 32-bit halves so the
+ *                96-bit product never has to exist
+ *   INPUTS: cycles -- TSC cycles
+ *   OUTPUTS: none
+ *   RETURN VALUE: the same time in ns
+ *   SIDE EFFECTS: none
+ */
+uint64_t cycles_to_ns(uint64_t cycles) {
+    uint64_t low = (uint64_t)(uint32_t)cycles * tsc_mult;
+    uint64_t high = (uint64_t)(uint32_t)(cycles >> 32) * tsc_mult;
+    return (low >> TSC_SHIFT) + (high << (32 - TSC_SHIFT));
+}
+
+/* 
+ * ktime_ns
+ *   DESCRIPTION: read the monotonic clock
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: nanoseconds since ktime_init
+ *   SIDE EFFECTS: none
+ */
+uint64_t ktime_ns() {
+    return cycles_to_ns(rdtsc() - tsc_base);
+}
+
+/* 
+ * gettime
+ *   DESCRIPTION: syscall that reads the monotonic clock
+ *   INPUTS: ns -- user address for the time
+ *   OUTPUTS: nanoseconds since boot at ns
+ *   RETURN VALUE: 0 on success
+ *                 -1 if ns is not in the user program's page
+ *   SIDE EFFECTS: none
+ */
+int32_t gettime(uint64_t* ns) {
+    /* check for range */
+    if ((uint32_t)ns < MB_128 || (uint32_t)ns > MB_132 - sizeof(uint64_t))
+        return -1;
+    *ns = ktime_ns();
+    return 0;
+}
@@ -0,0 +1,53 @@
+#ifndef _KTIME_H
+#define _KTIME_H
+
+#include "types.h"
+
+/* cycles to ns is (cycles * tsc_mult) >> TSC_SHIFT */
+#define TSC_SHIFT   24
+
+/* layout of the read-only page mapped at TIME_PAGE_VIRTUAL_ADDR in every
+ * process, ece391support.h has the user copy. Readers retry while seq is
+ * odd or changed under them
+ */
+typedef struct time_page {
+    volatile uint32_t seq;
+    /* clock: ns since boot = ((rdtsc - tsc_base) * tsc_mult) >> tsc_shift */
+    uint32_t tsc_khz;
+    uint32_t tsc_mult;
+    uint32_t tsc_shift;
+    uint64_t tsc_base;
+    /* PIT ticks since boot, their rate, and the clock at the last one */
+    uint64_t ticks;
+    uint32_t tick_hz;
+    uint64_t tick_ns;
+    /* scheduler: process switches since boot and running processes */
+    uint32_t switches;
+    uint32_t running;
+} time_page_t;
+
+/* TSC frequency in kHz, measured against the PIT by ktime_init */
+uint32_t tsc_khz;
+/* ns per TSC cycle, scaled by 1 << TSC_SHIFT */
+uint32_t tsc_mult;
+/* TSC value at ktime_init, time 0 of ktime_ns */
+uint64_t tsc_base;
+
+/* calibrate the TSC, call once at boot before anything reads the time */
+void ktime_init();
+/* convert a TSC cycle count to nanoseconds */
+uint64_t cycles_to_ns(uint64_t cycles);
+/* nanoseconds since ktime_init */
+uint64_t ktime_ns();
+
+/* the kernel's time page */
+uint8_t* time_page_frame();
+/* count a PIT tick in the time page */
+void time_page_tick();
+/* count a process switch in the time page */
+void time_page_switch();
+
+/* syscall: store nanoseconds since boot at a user address */
+extern int32_t gettime(uint64_t* ns);
+
+#endif
@@ -10,33 +10,92 @@
 #define TERM_Y      terminals[cur_term_id].cursor_y
 
 #define VIDEO_MEM  0xb8000
-#define SHIFT_4K   12
 
 #define CURSOR_STATUS_PORT  0x3D4
 #define CURSOR_DATA_PORT    0x3D5
 #define MASK_LOWER_8        0xFF
 #define CURSOR_POS_LOWER_8  0x0F
 #define CURSOR_POS_UPPER_8  0x0E
+#define START_ADDR_HIGH     0x0C
+#define START_ADDR_LOW      0x0D
+
+#define SCREEN_CELLS    (NUM_ROWS * NUM_COLS)
+#define VGA_CELLS       (VGA_WINDOW_SIZE >> 1)
+#define ROW_BYTES       (NUM_COLS << 1)
+/* row y of the displayed screen in the VGA window */
+#define VGA_ROW(y)      ((uint8_t *)VIDEO_MEM + ((vga_start + (y) * NUM_COLS) << 1))
+
+/* every terminal's screen, whole pages so vidmap can map them */
+static uint8_t screens[MAX_TERMINAL_NUM][SCREEN_PAGE_SIZE] __attribute__((aligned(SCREEN_PAGE_SIZE)));
+/* scratch copy for unrolling a screen ring */
+static uint8_t screen_tmp[SCREEN_BYTES];
+
+/*  
+ * screen_page
+ *   DESCRIPTION: find the page holding a terminal's RAM screen
+ *   INPUTS: term -- terminal index
+ *   OUTPUTS: none
+ *   RETURN VALUE: page address
+ *   SIDE EFFECTS: none
+ */
+uint8_t* screen_page(int32_t term) {
+    return screens[term];
+}
+
+/*  
+ * screen_row
+ *   DESCRIPTION: find a row of a terminal's RAM screen, a ring whose top
+ *                line is row top_row
+ *   INPUTS: t -- terminal
+ *           y -- row on the screen
+ *   OUTPUTS: none
+ *   RETURN VALUE: address of the row's first character byte
+ *   SIDE EFFECTS: none
+ */
+static inline uint8_t* screen_row(terminal_t* t, int32_t y) {
+    return screens[t - terminals] + ((t->top_row + y) % NUM_ROWS) * ROW_BYTES;
+}
+
+/*  
+ * push_rows
+ *   DESCRIPTION: copy rows of the displayed terminal's RAM screen to VGA
+ *   INPUTS: first -- first row to copy
+ *           count -- number of rows
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void push_rows(int32_t first, int32_t count) {
+    terminal_t* t = &terminal0;
+    int32_t y;
+    for (y = first; y < first + count; y++)
+        memcpy(VGA_ROW(y), screen_row(t, y), ROW_BYTES);
+}
 
 /*  
  * clear
- *   DESCRIPTION: clear the monitor
+ *   DESCRIPTION: clear the displayed terminal's screen, moving it back to
+ *                the start of the VGA window
  *   INPUTS: none
  *   OUTPUTS: none
  *   RETURN VALUE: none
  *   SIDE EFFECTS: none
  */
 void clear(void) {
+    uint8_t* screen = screens[active_term_idx];
     int32_t i;
+    terminal0.top_row = 0;
     for (i = 0; i < NUM_ROWS * NUM_COLS; i++) {
         if (i % NUM_COLS == 0) {
-            *(uint8_t *)(VIDEO_MEM + (i << 1)) = ' ';
+            screen[i << 1] = ' ';
         }
         else {
-            *(uint8_t *)(VIDEO_MEM + (i << 1)) = 0;
+            screen[i << 1] = 0;
         }
-        *(uint8_t *)(VIDEO_MEM + (i << 1) + 1) = ATTRIB;
+        screen[(i << 1) + 1] = ATTRIB;
     }
+    set_vga_start(0);
+    push_rows(0, NUM_ROWS);
 
     // reset char pos
     terminal0.cursor_x = 0;
@@ -46,7 +105,7 @@ void clear(void) {
 
 /*  
  * backspace
- *   DESCRIPTION: remove characters on screen
+ *   DESCRIPTION: remove characters on the displayed terminal's screen
  *   INPUTS: none
  *   OUTPUTS: none
  *   RETURN VALUE: none
@@ -54,16 +113,21 @@ void clear(void) {
  */
 void backspace(void) {
     int offset = terminal0.cursor_y * NUM_COLS + terminal0.cursor_x;
+    int x, y;
     if (!offset) return;
     offset--;
 
     // Remove the last character
-    *(uint8_t *)(VIDEO_MEM + (offset << 1)) = 0;
-    *(uint8_t *)(VIDEO_MEM + (offset << 1) + 1) = ATTRIB;
+    y = offset / NUM_COLS;
+    x = offset % NUM_COLS;
+    screen_row(&terminal0, y)[x << 1] = 0;
+    screen_row(&terminal0, y)[(x << 1) + 1] = ATTRIB;
+    VGA_ROW(y)[x << 1] = 0;
+    VGA_ROW(y)[(x << 1) + 1] = ATTRIB;
 
     offset--;
     // Skip the space
-    while (offset>=0 && *(uint8_t *)(VIDEO_MEM + (offset << 1)) == 0){
+    while (offset>=0 && screen_row(&terminal0, offset / NUM_COLS)[(offset % NUM_COLS) << 1] == 0){
         
         if( (offset + 1) % NUM_COLS == 0)
             break;
@@ -97,6 +161,7 @@ void enable_cursor(){
 /*  
  * update_cursor
  *   DESCRIPTION: update the cursor's location (in terminal)
+ *                on the displayed screen
  *   INPUTS: x -- cursor's x position
  *           y -- cursor's y position 
  *   OUTPUTS: none
@@ -104,7 +169,7 @@ void enable_cursor(){
  *   SIDE EFFECTS: none
  */
 void update_cursor(int x, int y){
-	uint16_t pos = y * NUM_COLS + x;
+	uint16_t pos = vga_start + y * NUM_COLS + x;
 	outb(CURSOR_POS_LOWER_8, CURSOR_STATUS_PORT);
 	outb((uint8_t) (pos & MASK_LOWER_8), CURSOR_DATA_PORT);
 	outb(CURSOR_POS_UPPER_8, CURSOR_STATUS_PORT);
@@ -113,40 +178,208 @@ void update_cursor(int x, int y){
 }
 
 /*  
- * scroll
- *   DESCRIPTION: scroll the scrolling bar
+ * set_vga_start
+ *   DESCRIPTION: show the screen starting at a cell of the VGA window by
+ *                programming the CRTC start address
+ *   INPUTS: start -- cell offset of the top-left corner, leaving a whole
+ *                    screen before the end of the window
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: the cursor must be updated after this
+ */
+void set_vga_start(uint32_t start) {
+    vga_start = start;
+    outb(START_ADDR_HIGH, CURSOR_STATUS_PORT);
+    /* 8: shift by 8 bits to get the upper byte */
+    outb((uint8_t) ((start >> 8) & MASK_LOWER_8), CURSOR_DATA_PORT);
+    outb(START_ADDR_LOW, CURSOR_STATUS_PORT);
+    outb((uint8_t) (start & MASK_LOWER_8), CURSOR_DATA_PORT);
+}
+
+/*  
+ * screen_normalize
+ *   DESCRIPTION: unroll a terminal's screen ring so its top line is the
+ *                first row of the page, as a vidmap page expects
+ *   INPUTS: term -- terminal index
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void screen_normalize(int32_t term) {
+    uint8_t* screen = screens[term];
+    uint32_t top = terminals[term].top_row * ROW_BYTES;
+
+    if (top == 0)
+        return;
+    memcpy(screen_tmp, screen + top, SCREEN_BYTES - top);
+    memcpy(screen_tmp + SCREEN_BYTES - top, screen, top);
+    memcpy(screen, screen_tmp, SCREEN_BYTES);
+    terminals[term].top_row = 0;
+}
+
+/*  
+ * rows_differ
+ *   DESCRIPTION: compare two screen rows a word at a time
+ *   INPUTS: a, b -- rows
+ *   OUTPUTS: none
+ *   RETURN VALUE: 1 if any cell differs, 0 if not
+ *   SIDE EFFECTS: none
+ */
+static int32_t rows_differ(const uint8_t* a, const uint8_t* b) {
+    const uint32_t* wa = (const uint32_t *)a;
+    const uint32_t* wb = (const uint32_t *)b;
+    int32_t i;
+    for (i = 0; i < ROW_BYTES / 4; i++) {
+        if (wa[i] != wb[i])
+            return 1;
+    }
+    return 0;
+}
+
+/*  
+ * screen_switch
+ *   DESCRIPTION: show another terminal's screen. VGA holds the previous
+ *                terminal's screen, so only the rows where the two RAM
+ *                screens differ are written; everything is written if a
+ *                vidmap page may have changed the previous screen since
+ *                the last push
+ *   INPUTS: prev_id -- terminal being displayed
+ *           next_id -- terminal to display, already active_term_idx
+ *   OUTPUTS: none
+ *   RETURN VALUE: number of rows written to VGA
+ *   SIDE EFFECTS: none
+ */
+int32_t screen_switch(int32_t prev_id, int32_t next_id) {
+    terminal_t* prev = &terminals[prev_id];
+    terminal_t* next = &terminals[next_id];
+    int32_t y, written = 0;
+
+    for (y = 0; y < NUM_ROWS; y++) {
+        if (prev->vidmap_users || rows_differ(screen_row(prev, y), screen_row(next, y))) {
+            memcpy(VGA_ROW(y), screen_row(next, y), ROW_BYTES);
+            written++;
+        }
+    }
+    return written;
+}
+
+/*  
+ * screen_sync
+ *   DESCRIPTION: push the displayed screen to VGA if a vidmap page may
+ *                have changed it behind write_screen's back; called every
+ *                pit tick
  *   INPUTS: none
  *   OUTPUTS: none
  *   RETURN VALUE: none
  *   SIDE EFFECTS: none
  */
-void scroll(void){
-    int32_t i, j;
-    int32_t offset;
-
-    uint32_t video_mem_local;
-    // scroll in the real video memory
-    if (cur_term_id == active_term_idx)
-        video_mem_local = VIDEO_MEM;
-    // scroll in the backup video memory
+void screen_sync(void) {
+    if (terminal0.vidmap_users)
+        push_rows(0, NUM_ROWS);
+}
+
+/*  
+ * scroll_term
+ *   DESCRIPTION: scroll a terminal's screen up one row. The RAM ring just
+ *                advances its top row, or shifts in place while vidmap
+ *                needs it linear. If the terminal is displayed, VGA moves
+ *                too by changing the CRTC start address, and is rewritten
+ *                from RAM only when it reaches the end of the window
+ *   INPUTS: term -- terminal index
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void scroll_term(int32_t term) {
+    terminal_t* t = &terminals[term];
+    uint8_t* row;
+    int32_t j;
+
+    if (!t->vidmap_users)
+        t->top_row = (t->top_row + 1) % NUM_ROWS;
     else
-        video_mem_local = VIDEO_MEM + ((cur_term_id + 1) << SHIFT_4K);
+        memmove(screens[term], screens[term] + ROW_BYTES, SCREEN_BYTES - ROW_BYTES);
 
-    for (i = 0; i < NUM_ROWS - 1; i++){
-        for(j = 0; j < NUM_COLS; j++){
-            offset = i * NUM_COLS + j;
-            *(uint8_t *)(video_mem_local + (offset << 1)) = *(uint8_t *)(video_mem_local + ((offset + NUM_COLS) << 1));
-            *(uint8_t *)(video_mem_local + (offset << 1) + 1) = ATTRIB;
-        }
+    row = screen_row(t, NUM_ROWS - 1);
+    for (j = 0; j < NUM_COLS; j++) {
+        row[j << 1] = 0;
+        row[(j << 1) + 1] = ATTRIB;
+    }
+    t->cursor_x = 0;
+    t->cursor_y = NUM_ROWS - 1;
+
+    if (term != active_term_idx)
+        return;
+    if (vga_start + SCREEN_CELLS + NUM_COLS <= VGA_CELLS) {
+        set_vga_start(vga_start + NUM_COLS);
+        push_rows(NUM_ROWS - 1, 1);
+    } else {
+        set_vga_start(0);
+        push_rows(0, NUM_ROWS);
     }
+}
 
-    for (j = 0; j < NUM_COLS; j++){
-        offset = i * NUM_COLS + j;
-        *(uint8_t *)(video_mem_local + (offset << 1)) = 0;
-        *(uint8_t *)(video_mem_local + (offset << 1) + 1) = ATTRIB;
+/*  
+ * write_screen
+ *   DESCRIPTION: write a buffer at a terminal's cursor a row at a time:
+ *                each row is filled in the terminal's RAM screen with
+ *                16-bit char + attribute stores, and the changed part is
+ *                copied to VGA once if the terminal is displayed. Newlines
+ *                clear the rest of the row, and the hardware cursor is
+ *                written once at the end
+ *   INPUTS: term -- terminal index
+ *           buf -- characters to write, NUL bytes are skipped
+ *           n -- number of bytes in buf
+ *   OUTPUTS: the characters on the terminal's screen
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: scrolls at the bottom of the screen
+ */
+void write_screen(int32_t term, const int8_t* buf, int32_t n) {
+    terminal_t* t = &terminals[term];
+    uint16_t* cell;
+    uint8_t c;
+    int32_t i = 0;
+    int32_t x0;
+
+    while (i < n) {
+        x0 = t->cursor_x;
+        cell = (uint16_t *)screen_row(t, t->cursor_y) + x0;
+        while (i < n && t->cursor_x < NUM_COLS) {
+            c = buf[i++];
+            if (c == '\n' || c == '\r') {
+                // clear the rest of the line
+                while (t->cursor_x < NUM_COLS) {
+                    *cell++ = ATTRIB << 8;
+                    t->cursor_x++;
+                }
+            } else if (c) {
+                *cell++ = (ATTRIB << 8) | c;
+                t->cursor_x++;
+            }
+        }
+        if (term == active_term_idx && t->cursor_x > x0)
+            memcpy(VGA_ROW(t->cursor_y) + (x0 << 1), screen_row(t, t->cursor_y) + (x0 << 1), (t->cursor_x - x0) << 1);
+        // Move to a new line, scroll down at the bottom
+        if (t->cursor_x == NUM_COLS) {
+            t->cursor_x = 0;
+            if (++t->cursor_y == NUM_ROWS)
+                scroll_term(term);
+        }
     }
-    terminals[cur_term_id].cursor_x = 0;
-    terminals[cur_term_id].cursor_y = NUM_ROWS - 1;
+    if (term == active_term_idx)
+        update_cursor(t->cursor_x, t->cursor_y);
+}
+
+/*  
+ * scroll
+ *   DESCRIPTION: scroll the scheduled terminal's screen
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void scroll(void){
+    scroll_term(cur_term_id);
 }
 
 
@@ -281,49 +514,21 @@ format_char_switch:
  *   Return Value: Number of bytes written
  *    Function: Output a string to the console */
 int32_t puts(int8_t* s) {
-    register int32_t index = 0;
-    while (s[index] != '\0') {
-        putc(s[index]);
-        index++;
-    }
+    register int32_t index = strlen(s);
+    write_screen(cur_term_id, s, index);
     return index;
 }
 
 /* void putc(uint8_t c);
  * Inputs: uint_8* c = character to print
  * Return Value: void
- *  Function: Output a character to the console */
+ *  Function: Output a character to the scheduled terminal */
 void putc(uint8_t c) {
-    uint32_t video_mem_local;
-    if (cur_term_id == active_term_idx)
-        video_mem_local = VIDEO_MEM;
-    else
-        video_mem_local = VIDEO_MEM + ((cur_term_id + 1) << SHIFT_4K);
-    
-    if(c == '\n' || c == '\r') {
-        while(terminals[cur_term_id].cursor_x++ < NUM_COLS)
-            *(uint8_t *)(video_mem_local + ((NUM_COLS * terminals[cur_term_id].cursor_y + terminals[cur_term_id].cursor_x) << 1)) = 0;
-        terminals[cur_term_id].cursor_y++;
-        terminals[cur_term_id].cursor_x = 0;
-    } else {
-        *(uint8_t *)(video_mem_local + ((NUM_COLS * terminals[cur_term_id].cursor_y + terminals[cur_term_id].cursor_x) << 1)) = c;
-        *(uint8_t *)(video_mem_local + ((NUM_COLS * terminals[cur_term_id].cursor_y + terminals[cur_term_id].cursor_x) << 1) + 1) = ATTRIB;
-        terminals[cur_term_id].cursor_x++;
-        terminals[cur_term_id].cursor_x %= NUM_COLS;
-        terminals[cur_term_id].cursor_y = (terminals[cur_term_id].cursor_y + (terminals[cur_term_id].cursor_x / NUM_COLS)) % NUM_ROWS;
-        // Move to a new line
-        if(!terminals[cur_term_id].cursor_x)
-            terminals[cur_term_id].cursor_y++;
-    }
-    // Scroll down
-    if(terminals[cur_term_id].cursor_y == NUM_ROWS)
-        scroll();
-    if (cur_term_id == active_term_idx)
-        update_cursor(terminals[cur_term_id].cursor_x, terminals[cur_term_id].cursor_y);
+    write_screen(cur_term_id, (int8_t *)&c, 1);
 }
 
 /* Standard printf_direct().
- * Description: similar to printf. ONLY called in keyboard handler. Write to both VIDEO_MEM and backup video
+ * Description: similar to printf. ONLY called in keyboard handler. Write to the displayed terminal
  * Only supports the following format strings:
  * %%  - print a literal '%' character
  * %x  - print a number in hexadecimal
@@ -453,97 +658,42 @@ format_char_switch:
 
 
 /* int32_t puts_direct(int8_t* s);
- *  Description: similar to puts. ONLY called in keyboard handler. Write to both VIDEO_MEM and backup video
+ *  Description: similar to puts. ONLY called in keyboard handler. Write to the displayed terminal
  *    Inputs: int_8* s = pointer to a string of characters
  *    Return Value: Number of bytes written
  *    Function: Output a string to the console 
  */
 int32_t puts_direct(int8_t* s) {
-    register int32_t index = 0;
-    while (s[index] != '\0') {
-        putc_direct(s[index]);
-        index++;
-    }
+    register int32_t index = strlen(s);
+    write_screen(active_term_idx, s, index);
     return index;
 }
 
 
 /* void putc_direct(uint8_t c);
- *  Description: similar to putc. ONLY called in keyboard handler. Write to both VIDEO_MEM and backup video
+ *  Description: similar to putc. ONLY called in keyboard handler. Write to the displayed terminal
  *  Inputs: uint_8* c = character to print
  *  Return Value: void
  *  Function: Output a character to the console 
  */
 void putc_direct(uint8_t c) {
-    if(c == '\n' || c == '\r') {
-        while(terminals[active_term_idx].cursor_x++ < NUM_COLS) {
-            // write to real video memory
-            *(uint8_t *)(VIDEO_MEM + ((NUM_COLS * terminals[active_term_idx].cursor_y + terminals[active_term_idx].cursor_x) << 1)) = 0;
-            // write to backup video memory
-            *(uint8_t *)(VIDEO_MEM + ((active_term_idx + 1) << SHIFT_4K) +((NUM_COLS * terminals[active_term_idx].cursor_y + terminals[active_term_idx].cursor_x) << 1)) = 0;
-        }
-        terminals[active_term_idx].cursor_y++;
-        terminals[active_term_idx].cursor_x = 0;
-    } else {
-        *(uint8_t *)(VIDEO_MEM + ((NUM_COLS * terminals[active_term_idx].cursor_y + terminals[active_term_idx].cursor_x) << 1)) = c;
-        *(uint8_t *)(VIDEO_MEM + ((NUM_COLS * terminals[active_term_idx].cursor_y + terminals[active_term_idx].cursor_x) << 1) + 1) = ATTRIB;
-        *(uint8_t *)(VIDEO_MEM + ((active_term_idx + 1) << SHIFT_4K) +((NUM_COLS * terminals[active_term_idx].cursor_y + terminals[active_term_idx].cursor_x) << 1)) = c;
-        *(uint8_t *)(VIDEO_MEM + ((active_term_idx + 1) << SHIFT_4K) +((NUM_COLS * terminals[active_term_idx].cursor_y + terminals[active_term_idx].cursor_x) << 1) + 1) = ATTRIB;
-        terminals[active_term_idx].cursor_x++;
-        terminals[active_term_idx].cursor_x %= NUM_COLS;
-        terminals[active_term_idx].cursor_y = (terminals[active_term_idx].cursor_y + (terminals[active_term_idx].cursor_x / NUM_COLS)) % NUM_ROWS;
-        // Move to a new line
-        if(!terminals[active_term_idx].cursor_x)
-            terminals[active_term_idx].cursor_y++;
-    }
-    // Scroll down
-    if(terminals[active_term_idx].cursor_y == NUM_ROWS)
-        scroll_direct();
-
-    update_cursor(terminals[active_term_idx].cursor_x, terminals[active_term_idx].cursor_y);
+    write_screen(active_term_idx, (int8_t *)&c, 1);
 }
 
 
 /*  
  * scroll_direct
- *   DESCRIPTION: scroll the scrolling bar
+ *   DESCRIPTION: scroll the displayed terminal's screen
  *   INPUTS: none
  *   OUTPUTS: none
  *   RETURN VALUE: none
  *   SIDE EFFECTS: none
  */
 void scroll_direct(void){
-    int32_t i, j;
-    int32_t offset;
-
-    for (i = 0; i < NUM_ROWS - 1; i++){
-        for(j = 0; j < NUM_COLS; j++){
-            offset = i * NUM_COLS + j;
-            *(uint8_t *)(VIDEO_MEM + (offset << 1)) = *(uint8_t *)(VIDEO_MEM + ((offset + NUM_COLS) << 1));
-            *(uint8_t *)(VIDEO_MEM + (offset << 1) + 1) = ATTRIB;
-            *(uint8_t *)(VIDEO_MEM + ((active_term_idx + 1) << SHIFT_4K)+(offset << 1)) = *(uint8_t *)(VIDEO_MEM + ((offset + NUM_COLS) << 1));
-            *(uint8_t *)(VIDEO_MEM + ((active_term_idx + 1) << SHIFT_4K)+ (offset << 1) + 1) = ATTRIB;
-        }
-    }
-
-    for (j = 0; j < NUM_COLS; j++){
-        offset = i * NUM_COLS + j;
-        *(uint8_t *)(VIDEO_MEM+ (offset << 1)) = 0;
-        *(uint8_t *)(VIDEO_MEM + (offset << 1) + 1) = ATTRIB;
-        *(uint8_t *)(VIDEO_MEM + ((active_term_idx + 1) << SHIFT_4K) + (offset << 1)) = *(uint8_t *)(VIDEO_MEM+ ((offset + NUM_COLS) << 1));
-        *(uint8_t *)(VIDEO_MEM+ ((active_term_idx + 1) << SHIFT_4K) + (offset << 1) + 1) = ATTRIB;
-    }
-    terminals[active_term_idx].cursor_x = 0;
-    terminals[active_term_idx].cursor_y = NUM_ROWS - 1;
+    scroll_term(active_term_idx);
 }
 
 
-
-
-
-
-
-
 /* int8_t* itoa(uint32_t value, int8_t* buf, int32_t radix);
  * Inputs: uint32_t value = number to convert
  *            int8_t* buf = allocated buffer to place string in
@@ -828,6 +978,31 @@ int8_t* strncpy(int8_t* dest, const int8_t* src, uint32_t n) {
     return dest;
 }
 
+/* uint64_t div_u64_u32(uint64_t dividend, uint32_t divisor, uint32_t* remainder)
+ * Inputs: uint64_t dividend = number to divide
+ *         uint32_t divisor = number to divide by, must not be 0
+ *         uint32_t* remainder = filled with the remainder if not NULL
+ * Return Value: quotient
+ * Function: 64-bit by 32-bit division done with two divl, since the kernel
+ *           is linked without libgcc and cannot call __udivdi3 */
+uint64_t div_u64_u32(uint64_t dividend, uint32_t divisor, uint32_t* remainder) {
+    uint32_t high = (uint32_t)(dividend >> 32);
+    uint32_t low = (uint32_t)dividend;
+    uint32_t q_high = high / divisor;
+    uint32_t rem = high % divisor;
+    uint32_t q_low;
+
+    /* rem < divisor, so the second quotient always fits in 32 bits */
+    asm ("divl %4"
+            : "=a"(q_low), "=d"(rem)
+            : "a"(low), "d"(rem), "rm"(divisor)
+            : "cc"
+    );
+    if (remainder)
+        *remainder = rem;
+    return ((uint64_t)q_high << 32) | q_low;
+}
+
 /* void test_interrupts(void)
  * Inputs: void
  * Return Value: void
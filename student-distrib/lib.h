@@ -13,8 +13,17 @@
 #define ATTRIB      0x7
 #define VIDEO       0xB8000
 
+/* the VGA text window the displayed screen scrolls through */
+#define VGA_WINDOW_SIZE 0x8000
+#define SCREEN_BYTES    (NUM_ROWS * NUM_COLS * 2)
+/* a terminal's RAM screen fills one page */
+#define SCREEN_PAGE_SIZE    4096
+
 char* video_mem;
 
+/* cell offset of the displayed screen's top row in the VGA window */
+uint32_t vga_start;
+
 int screen_x;
 int screen_y;
 
@@ -22,6 +31,7 @@ int32_t printf(int8_t *format, ...);
 void putc(uint8_t c);
 int32_t puts(int8_t *s);
 void scroll(void);
+void write_screen(int32_t term, const int8_t* buf, int32_t n);
 
 // ONLY called in keyboard handler
 int32_t printf_direct(int8_t *format, ...);
@@ -37,6 +47,11 @@ void backspace(void);
 void newline(void);
 void enable_cursor();
 void update_cursor(int x, int y);
+void set_vga_start(uint32_t start);
+uint8_t* screen_page(int32_t term);
+void screen_normalize(int32_t term);
+int32_t screen_switch(int32_t prev_id, int32_t next_id);
+void screen_sync(void);
 
 void* memset(void* s, int32_t c, uint32_t n);
 void* memset_word(void* s, int32_t c, uint32_t n);
@@ -47,6 +62,9 @@ int32_t strncmp(const int8_t* s1, const int8_t* s2, uint32_t n);
 int8_t* strcpy(int8_t* dest, const int8_t*src);
 int8_t* strncpy(int8_t* dest, const int8_t*src, uint32_t n);
 
+/* 64-bit by 32-bit division without libgcc */
+uint64_t div_u64_u32(uint64_t dividend, uint32_t divisor, uint32_t* remainder);
+
 /* Userspace address-check functions */
 int32_t bad_userspace_addr(const void* addr, int32_t len);
 int32_t safe_strncpy(int8_t* dest, const int8_t* src, int32_t n);
@@ -98,6 +116,31 @@ static inline uint32_t inl(int port) {
     return val;
 }
 
+/* Reads the 64-bit time-stamp counter */
+static inline uint64_t rdtsc(void) {
+    uint32_t low, high;
+    asm volatile ("rdtsc"
+            : "=a"(low), "=d"(high)
+            :
+            : "memory"
+    );
+    return ((uint64_t)high << 32) | low;
+}
+
+/* Index of the lowest set bit, word must not be 0 */
+static inline uint32_t bsf(uint32_t word) {
+    uint32_t index;
+    asm ("bsfl %1, %0"
+            : "=r"(index)
+            : "rm"(word)
+            : "cc"
+    );
+    return index;
+}
+
+/* Keeps the compiler from moving memory accesses across this point */
+#define barrier()   asm volatile ("" : : : "memory")
+
 /* Writes a byte to a port */
 #define outb(data, port)                \
 do {                                    \
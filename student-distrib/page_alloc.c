@@ -0,0 +1,322 @@
+#include "lib.h"
+#include "types.h"
+#include "page_alloc.h"
+
+#define FRAME_SHIFT     12
+#define FRAME_SIZE      (1 << FRAME_SHIFT)
+
+/* frame_state of the first frame of a block: FRAME_FREE | order while it
+ * is free, FRAME_USED | order while page_alloc has handed it out */
+#define FRAME_FREE      0x80
+#define FRAME_USED      0x40
+#define FRAME_ORDER     0x3F
+
+page_stats_t page_stats;
+
+/* a free block's links live in its own first frame */
+typedef struct free_block {
+    struct free_block* next;
+    struct free_block* prev;
+} free_block_t;
+
+/* free blocks of each order, and a bit per non-empty list */
+static free_block_t* free_lists[PAGE_MAX_ORDER + 1];
+static uint32_t free_orders;
+/* one byte per frame, non-zero only for the head of a block */
+static uint8_t frame_state[PAGE_POOL_FRAMES];
+
+/* ranges recorded from the boot information */
+typedef struct page_region {
+    uint32_t start;
+    uint32_t end;
+} page_region_t;
+
+static page_region_t usable[PAGE_REGIONS_MAX];
+static uint32_t usable_count = 0;
+static page_region_t reserved[PAGE_REGIONS_MAX];
+static uint32_t reserved_count = 0;
+
+/*  
+ * block_push
+ *   DESCRIPTION: put a block on the free list of its order
+ *   INPUTS: frame -- index of the block's first frame
+ *           order -- block order
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void block_push(uint32_t frame, uint32_t order) {
+    free_block_t* block = (free_block_t*)(PAGE_POOL_START + (frame << FRAME_SHIFT));
+    block->prev = NULL;
+    block->next = free_lists[order];
+    if (block->next != NULL)
+        block->next->prev = block;
+    free_lists[order] = block;
+    free_orders |= 1 << order;
+    frame_state[frame] = FRAME_FREE | order;
+    page_stats.free_blocks[order]++;
+}
+
+/*  
+ * block_unlink
+ *   DESCRIPTION: take a block off the free list of its order
+ *   INPUTS: frame -- index of the block's first frame
+ *           order -- block order
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void block_unlink(uint32_t frame, uint32_t order) {
+    free_block_t* block = (free_block_t*)(PAGE_POOL_START + (frame << FRAME_SHIFT));
+    if (block->prev != NULL)
+        block->prev->next = block->next;
+    else
+        free_lists[order] = block->next;
+    if (block->next != NULL)
+        block->next->prev = block->prev;
+    if (free_lists[order] == NULL)
+        free_orders &= ~(1 << order);
+    frame_state[frame] = 0;
+    page_stats.free_blocks[order]--;
+}
+
+/*  
+ * block_free
+ *   DESCRIPTION: free a block, merging it with its buddy for as long as
+ *                the buddy is a free block of the same order
+ *   INPUTS: frame -- index of the block's first frame
+ *           order -- block order
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void block_free(uint32_t frame, uint32_t order) {
+    uint32_t buddy;
+    page_stats.free_frames += 1 << order;
+    while (order < PAGE_MAX_ORDER) {
+        buddy = frame ^ (1 << order);
+        if (buddy >= PAGE_POOL_FRAMES || frame_state[buddy] != (FRAME_FREE | order))
+            break;
+        block_unlink(buddy, order);
+        frame &= ~(1 << order);
+        order++;
+        page_stats.merges++;
+    }
+    block_push(frame, order);
+}
+
+/*  
+ * free_range
+ *   DESCRIPTION: free every frame of [start, end) as the largest aligned
+ *                blocks that fit
+ *   INPUTS: start, end -- frame indices
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: counts the frames as usable
+ */
+static void free_range(uint32_t start, uint32_t end) {
+    uint32_t order;
+    while (start < end) {
+        order = (start == 0) ? PAGE_MAX_ORDER : bsf(start);
+        if (order > PAGE_MAX_ORDER)
+            order = PAGE_MAX_ORDER;
+        while (start + (1 << order) > end)
+            order--;
+        page_stats.total_frames += 1 << order;
+        block_free(start, order);
+        start += 1 << order;
+    }
+}
+
+/*  
+ * page_alloc_add_region
+ *   DESCRIPTION: remember a range of usable RAM; init_page_alloc frees the
+ *                part of it inside the pool
+ *   INPUTS: start -- first byte
+ *           end -- byte past the range
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: ranges past PAGE_REGIONS_MAX are ignored
+ */
+void page_alloc_add_region(uint32_t start, uint32_t end) {
+    if (usable_count < PAGE_REGIONS_MAX && start < end) {
+        usable[usable_count].start = start;
+        usable[usable_count].end = end;
+        usable_count++;
+    }
+}
+
+/*  
+ * page_alloc_reserve
+ *   DESCRIPTION: remember a range init_page_alloc must leave alone
+ *   INPUTS: start -- first byte
+ *           end -- byte past the range
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: ranges past PAGE_REGIONS_MAX are ignored
+ */
+void page_alloc_reserve(uint32_t start, uint32_t end) {
+    if (reserved_count < PAGE_REGIONS_MAX && start < end) {
+        /* whole frames, so a reserved frame is never half free */
+        reserved[reserved_count].start = start & ~(FRAME_SIZE - 1);
+        reserved[reserved_count].end = (end + FRAME_SIZE - 1) & ~(FRAME_SIZE - 1);
+        reserved_count++;
+    }
+}
+
+/*  
+ * init_page_alloc
+ *   DESCRIPTION: build the free lists from the usable ranges, clipped to
+ *                the pool and with the reserved ranges cut out. Without a
+ *                memory map the whole pool is taken as usable
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: resets the allocator; the pool must be mapped
+ */
+void init_page_alloc() {
+    uint32_t i, j, start, end, cut, moved;
+
+    memset(free_lists, 0, sizeof(free_lists));
+    memset(frame_state, 0, sizeof(frame_state));
+    memset(&page_stats, 0, sizeof(page_stats));
+    free_orders = 0;
+    if (usable_count == 0)
+        page_alloc_add_region(PAGE_POOL_START, PAGE_POOL_END);
+
+    for (i = 0; i < usable_count; i++) {
+        /* whole frames inside the pool */
+        start = (usable[i].start + FRAME_SIZE - 1) & ~(FRAME_SIZE - 1);
+        end = usable[i].end & ~(FRAME_SIZE - 1);
+        if (start < PAGE_POOL_START)
+            start = PAGE_POOL_START;
+        if (end > PAGE_POOL_END)
+            end = PAGE_POOL_END;
+
+        /* free the pieces between reserved ranges, in address order */
+        while (start < end) {
+            /* step over reserved ranges covering start */
+            do {
+                moved = 0;
+                for (j = 0; j < reserved_count; j++) {
+                    if (reserved[j].start <= start && reserved[j].end > start) {
+                        start = reserved[j].end;
+                        moved = 1;
+                    }
+                }
+            } while (moved);
+            if (start >= end)
+                break;
+            /* free up to the next reserved range */
+            cut = end;
+            for (j = 0; j < reserved_count; j++) {
+                if (reserved[j].start > start && reserved[j].start < cut)
+                    cut = reserved[j].start;
+            }
+            free_range((start - PAGE_POOL_START) >> FRAME_SHIFT, (cut - PAGE_POOL_START) >> FRAME_SHIFT);
+            start = cut;
+        }
+    }
+    page_stats.merges = 0;
+}
+
+/*  
+ * page_alloc
+ *   DESCRIPTION: allocate 1 << order physically contiguous frames, aligned
+ *                to their size: take the smallest non-empty free list of
+ *                at least that order, found with one bsf, and split the
+ *                block down, freeing the upper halves
+ *   INPUTS: order -- 0 to PAGE_MAX_ORDER
+ *   OUTPUTS: none
+ *   RETURN VALUE: physical (and kernel) address of the block, 0 if none
+ *   SIDE EFFECTS: none
+ */
+uint32_t page_alloc(uint32_t order) {
+    uint64_t start = rdtsc();
+    uint32_t avail, cur, frame, cycles;
+
+    if (order > PAGE_MAX_ORDER) {
+        page_stats.failures++;
+        return 0;
+    }
+    avail = free_orders & ~((1 << order) - 1);
+    if (!avail) {
+        page_stats.failures++;
+        return 0;
+    }
+    cur = bsf(avail);
+    frame = ((uint32_t)free_lists[cur] - PAGE_POOL_START) >> FRAME_SHIFT;
+    block_unlink(frame, cur);
+    while (cur > order) {
+        cur--;
+        block_push(frame + (1 << cur), cur);
+        page_stats.splits++;
+    }
+
+    frame_state[frame] = FRAME_USED | order;
+    page_stats.allocs++;
+    page_stats.free_frames -= 1 << order;
+    cycles = (uint32_t)(rdtsc() - start);
+    page_stats.alloc_cycles += cycles;
+    if (cycles > page_stats.max_alloc_cycles)
+        page_stats.max_alloc_cycles = cycles;
+    return PAGE_POOL_START + (frame << FRAME_SHIFT);
+}
+
+/*  
+ * page_free
+ *   DESCRIPTION: return a block from page_alloc, merging it with free buddies
+ *   INPUTS: addr -- address returned by page_alloc
+ *           order -- order passed to page_alloc
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: a free of anything but the head of an allocated block of
+ *                 that order is ignored and counted in bad_frees
+ */
+void page_free(uint32_t addr, uint32_t order) {
+    uint32_t frame;
+
+    if (addr < PAGE_POOL_START || addr >= PAGE_POOL_END || order > PAGE_MAX_ORDER) {
+        page_stats.bad_frees++;
+        return;
+    }
+    frame = (addr - PAGE_POOL_START) >> FRAME_SHIFT;
+    /* already free, inside a block, or allocated with another order */
+    if (frame_state[frame] != (FRAME_USED | order)) {
+        page_stats.bad_frees++;
+        return;
+    }
+    /* the block may merge into a lower buddy, so its head mark must go now */
+    frame_state[frame] = 0;
+    block_free(frame, order);
+    page_stats.frees++;
+}
+
+/*  
+ * print_page_stats
+ *   DESCRIPTION: print page allocator counters, the free blocks of each
+ *                order, and external fragmentation: the share of free
+ *                memory that is in blocks smaller than 4MB
+ *   INPUTS: none
+ *   OUTPUTS: counters to the screen
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void print_page_stats() {
+    uint32_t order, small = 0;
+    uint32_t avg = page_stats.allocs ? (uint32_t)div_u64_u32(page_stats.alloc_cycles, page_stats.allocs, NULL) : 0;
+
+    printf("frames: %d free of %d, %d allocs, %d frees, %d failures, %d bad frees\n",
+           page_stats.free_frames, page_stats.total_frames, page_stats.allocs,
+           page_stats.frees, page_stats.failures, page_stats.bad_frees);
+    printf("buddy: %d splits, %d merges, alloc avg %d max %d cycles\n",
+           page_stats.splits, page_stats.merges, avg, page_stats.max_alloc_cycles);
+    printf("free blocks by order:");
+    for (order = 0; order <= PAGE_MAX_ORDER; order++) {
+        printf(" %d", page_stats.free_blocks[order]);
+        if (order < PAGE_MAX_ORDER)
+            small += page_stats.free_blocks[order] << order;
+    }
+    printf("\nfragmentation: %d%% of free frames below order %d\n",
+           page_stats.free_frames ? small * 100 / page_stats.free_frames : 0, PAGE_MAX_ORDER);
+}
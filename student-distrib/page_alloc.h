@@ -0,0 +1,52 @@
+#ifndef _PAGE_ALLOC_H
+#define _PAGE_ALLOC_H
+
+#include "types.h"
+
+/* physical memory the allocator may hand out as 4KB frames, identity mapped
+   by the kernel; only the parts multiboot reports as usable RAM are used */
+#define PAGE_POOL_START     0x00800000
+#define PAGE_POOL_END       0x08000000
+#define PAGE_POOL_FRAMES    ((PAGE_POOL_END - PAGE_POOL_START) >> 12)
+
+/* largest block: 1 << PAGE_MAX_ORDER frames (4MB), naturally aligned */
+#define PAGE_MAX_ORDER      10
+
+/* memory map ranges remembered before the allocator is initialized */
+#define PAGE_REGIONS_MAX    16
+
+typedef struct page_stats {
+    uint32_t allocs;
+    uint32_t frees;
+    uint32_t failures;
+    /* page_free calls refused: double frees, wrong order, not a block */
+    uint32_t bad_frees;
+    uint32_t free_frames;
+    /* usable frames found in the memory map */
+    uint32_t total_frames;
+    /* blocks halved to serve a smaller order, buddies merged on free */
+    uint32_t splits;
+    uint32_t merges;
+    /* TSC cycles spent in page_alloc */
+    uint64_t alloc_cycles;
+    uint32_t max_alloc_cycles;
+    /* free blocks of each order */
+    uint32_t free_blocks[PAGE_MAX_ORDER + 1];
+} page_stats_t;
+
+extern page_stats_t page_stats;
+
+/* remember a range of usable RAM from the multiboot memory map */
+void page_alloc_add_region(uint32_t start, uint32_t end);
+/* remember a range that must never be handed out (boot modules) */
+void page_alloc_reserve(uint32_t start, uint32_t end);
+/* build the free lists from the remembered ranges */
+void init_page_alloc();
+/* allocate 1 << order contiguous frames */
+uint32_t page_alloc(uint32_t order);
+/* return a block from page_alloc */
+void page_free(uint32_t addr, uint32_t order);
+/* print allocator counters, free blocks per order and fragmentation */
+void print_page_stats();
+
+#endif
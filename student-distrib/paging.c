@@ -2,6 +2,8 @@
 #include "paging.h"
 #include "scheduling.h"
 #include "keyboard.h"
+#include "page_alloc.h"
+#include "ktime.h"
 
 
 #define PROGRAM_DIRECTORY_INDEX         PROGRAM_DIRECTORY_VIRTUAL_ADDR >> SHIFT_4M
@@ -15,27 +17,15 @@
  *   SIDE EFFECTS: initialize one directory, one table, cr3, and cr4+cr0
  */
 void init_paging() {
+    demand_paging = 1;
     init_directory();
     init_table_0();
-    init_prog_vid();
+    memset(time_table, 0, NUM_ENTRY * sizeof(page_table_entry_t));
+    map_time_page(time_table);
     load_page_directory(page_directory);
     enable_paging();
 }
 
-/* 
- * setup_paging
- *   DESCRIPTION: setup paging for the current program
- *   INPUTS: prog_counter -- current program page index
- *   OUTPUTS: none
- *   RETURN VALUE: none
- *   SIDE EFFECTS: enable one directory entry and flush tlb (set cr3)
- */
-void setup_paging(int32_t prog_counter) {
-    enable_program_page(prog_counter);
-    flush_tlb();
-    //enable_paging();
-}
-
 /* 
  * init_directory
  *   DESCRIPTION: initialize the page directory
@@ -56,7 +46,7 @@ void init_directory() {
         page_directory[i].access = 0;
         page_directory[i].reserve_0 = 0;
         page_directory[i].page_size = 0;
-        page_directory[i].ignored = 0;
+        page_directory[i].global = 0;
         page_directory[i].reserve_1 = 0;
         page_directory[i].page_table_addr = 0;
     }
@@ -71,34 +61,184 @@ void init_directory() {
     page_directory[1].access = 0;
     page_directory[1].reserve_0 = 0;
     page_directory[1].page_size = 1; //4MB
-    page_directory[1].ignored = 1;
+    page_directory[1].global = 1;   //same in every address space
     page_directory[1].reserve_1 = 0;
     page_directory[1].page_table_addr = PD_1_ADDR;
+
+    /* identity map the page allocator's pool, kernel only */
+    for (i = PAGE_POOL_START >> SHIFT_4M; i < PAGE_POOL_END >> SHIFT_4M; i++) {
+        page_directory[i].present = 1;
+        page_directory[i].page_size = 1; //4MB
+        page_directory[i].global = 1;
+        page_directory[i].page_table_addr = (i << SHIFT_4M) >> SHIFT_4K;
+    }
 }
 
 /* 
- * enable_program_page
- *   DESCRIPTION: enable 8mb-12mb page
- *   INPUTS: prog_counter -- current program page index
+ * init_page_directory
+ *   DESCRIPTION: set up a process's page directory: the kernel half points
+ *                at the same tables and 4MB pages as the boot directory,
+ *                the 128MB-132MB entry at the process's program table, and
+ *                the 132MB-136MB entry at the shared table of the time page
+ *   INPUTS: dir -- the process's page directory
+ *           table -- the process's program page table
  *   OUTPUTS: none
  *   RETURN VALUE: none
- *   SIDE EFFECTS: enable 8mb-12mb directory entry and flush tlb (set cr3)
+ *   SIDE EFFECTS: none
  */
-void enable_program_page(int32_t prog_counter) {
-    int32_t physical_addr = prog_counter * FOUR_MB + EIGHT_MB;
-
-    /* initialize the program 4MB page */
-    page_directory[PROGRAM_DIRECTORY_INDEX].present = 1;
-    page_directory[PROGRAM_DIRECTORY_INDEX].r_w = 1;
-    page_directory[PROGRAM_DIRECTORY_INDEX].u_s = 1; //user mode
-    page_directory[PROGRAM_DIRECTORY_INDEX].write_t = 0;
-    page_directory[PROGRAM_DIRECTORY_INDEX].cache_dis = 0;
-    page_directory[PROGRAM_DIRECTORY_INDEX].access = 0;
-    page_directory[PROGRAM_DIRECTORY_INDEX].reserve_0 = 0;
-    page_directory[PROGRAM_DIRECTORY_INDEX].page_size = 1;
-    page_directory[PROGRAM_DIRECTORY_INDEX].ignored = 1;
-    page_directory[PROGRAM_DIRECTORY_INDEX].reserve_1 = 0;
-    page_directory[PROGRAM_DIRECTORY_INDEX].page_table_addr = physical_addr >> SHIFT_4K; //0x800, 0xC00
+void init_page_directory(page_dicr_entry_t* dir, page_table_entry_t* table) {
+    memcpy(dir, page_directory, NUM_ENTRY * sizeof(page_dicr_entry_t));
+
+    /* 4KB pages so the image can be filled one page at a time */
+    dir[PROGRAM_DIRECTORY_INDEX].present = 1;
+    dir[PROGRAM_DIRECTORY_INDEX].r_w = 1;
+    dir[PROGRAM_DIRECTORY_INDEX].u_s = 1; //user mode
+    dir[PROGRAM_DIRECTORY_INDEX].page_size = 0;
+    dir[PROGRAM_DIRECTORY_INDEX].page_table_addr = (uint32_t)table >> SHIFT_4K;
+
+    /* vidmap swaps in a table of the process's own */
+    dir[PROG_VID_ENTRY].present = 1;
+    dir[PROG_VID_ENTRY].r_w = 1;
+    dir[PROG_VID_ENTRY].u_s = 1;
+    dir[PROG_VID_ENTRY].page_table_addr = (uint32_t)time_table >> SHIFT_4K;
+}
+
+/* 
+ * clear_program_pages
+ *   DESCRIPTION: mark every page of a program's 128MB-132MB region not present,
+ *                so the next touch of each page faults it in, and give the
+ *                process's own frames back to the page allocator
+ *   INPUTS: table -- the process's program page table
+ *           batch -- collects the pages that were present, NULL if the
+ *                    table is not live
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: caller must flush the batch
+ */
+void clear_program_pages(page_table_entry_t* table, tlb_batch_t* batch) {
+    uint32_t i;
+    for (i = 0; i < NUM_ENTRY; i++) {
+        if (!table[i].present)
+            continue;
+        if (!(table[i].reserve_1 & PTE_SHARED))
+            page_free(table[i].page_base_addr << SHIFT_4K, 0);
+        if (batch != NULL)
+            tlb_batch_add(batch, PROGRAM_PAGE_VIRTUAL_ADDR + (i << SHIFT_4K));
+    }
+    memset(table, 0, NUM_ENTRY * sizeof(page_table_entry_t));
+}
+
+/* 
+ * program_pte
+ *   DESCRIPTION: find the entry of a program page
+ *   INPUTS: table -- the process's program page table
+ *           vaddr -- any address in the page, inside 128MB-132MB
+ *   OUTPUTS: none
+ *   RETURN VALUE: pointer to the entry
+ *   SIDE EFFECTS: none
+ */
+static page_table_entry_t* program_pte(page_table_entry_t* table, uint32_t vaddr) {
+    return &table[((vaddr - PROGRAM_PAGE_VIRTUAL_ADDR) & PAGE_MASK) >> SHIFT_4K];
+}
+
+/* 
+ * set_program_pte
+ *   DESCRIPTION: fill one user page table entry of a program's region
+ *   INPUTS: pte -- entry to fill
+ *           physical_addr -- frame backing the page
+ *           r_w -- 1 if the process may write the page
+ *           avail -- PTE_SHARED / PTE_COW bits for the available field
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: caller must invalidate the page if the table is live
+ */
+static void set_program_pte(page_table_entry_t* pte, uint32_t physical_addr, uint32_t r_w, uint32_t avail) {
+    pte->present = 1;
+    pte->r_w = r_w;
+    pte->u_s = 1;
+    pte->write_t = 0;
+    pte->cache_dis = 0;
+    pte->access = 0;
+    pte->dirty = 0;
+    pte->ptai = 0;
+    pte->global = 0;
+    pte->reserve_1 = avail;
+    pte->page_base_addr = physical_addr >> SHIFT_4K;
+}
+
+/* 
+ * map_program_page
+ *   DESCRIPTION: back one 4KB program page with a frame of the process's
+ *                own, keeping the frame it already has
+ *   INPUTS: table -- the process's program page table
+ *           vaddr -- any address in the page, inside 128MB-132MB
+ *           r_w -- 1 if the process may write the page
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 if successful
+ *                 -1 if out of memory
+ *   SIDE EFFECTS: caller must invalidate the page if the table is live
+ */
+int32_t map_program_page(page_table_entry_t* table, uint32_t vaddr, uint32_t r_w) {
+    page_table_entry_t* pte = program_pte(table, vaddr);
+    uint32_t frame;
+
+    if (pte->present && !(pte->reserve_1 & PTE_SHARED))
+        frame = pte->page_base_addr << SHIFT_4K;
+    else if ((frame = page_alloc(0)) == 0)
+        return -1;
+    set_program_pte(pte, frame, r_w, 0);
+    return 0;
+}
+
+/* 
+ * map_shared_page
+ *   DESCRIPTION: map one program page read-only onto a frame shared with
+ *                other processes
+ *   INPUTS: table -- the process's program page table
+ *           vaddr -- any address in the page, inside 128MB-132MB
+ *           frame -- physical address of the shared frame
+ *           cow -- 1 if a write should get a private copy, 0 if a write
+ *                  is an error (text)
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: caller must invalidate the page if the table is live
+ */
+void map_shared_page(page_table_entry_t* table, uint32_t vaddr, uint32_t frame, uint32_t cow) {
+    page_table_entry_t* pte = program_pte(table, vaddr);
+    if (pte->present && !(pte->reserve_1 & PTE_SHARED))
+        page_free(pte->page_base_addr << SHIFT_4K, 0);
+    set_program_pte(pte, frame, 0, cow ? (PTE_SHARED | PTE_COW) : PTE_SHARED);
+}
+
+/* 
+ * is_cow_page
+ *   DESCRIPTION: check whether a write to a program page should copy it
+ *   INPUTS: table -- the process's program page table
+ *           vaddr -- any address in the page, inside 128MB-132MB
+ *   OUTPUTS: none
+ *   RETURN VALUE: 1 if the page is present and copy-on-write, 0 otherwise
+ *   SIDE EFFECTS: none
+ */
+int32_t is_cow_page(page_table_entry_t* table, uint32_t vaddr) {
+    page_table_entry_t* pte = program_pte(table, vaddr);
+    return (pte->present && (pte->reserve_1 & PTE_COW)) ? 1 : 0;
+}
+
+/* 
+ * is_shared_page
+ *   DESCRIPTION: check whether a program page is mapped onto a shared frame
+ *   INPUTS: table -- the process's program page table
+ *           vaddr -- any address in the page, inside 128MB-132MB
+ *   OUTPUTS: none
+ *   RETURN VALUE: physical address of the shared frame, 0 if the page is
+ *                 not present or private
+ *   SIDE EFFECTS: none
+ */
+uint32_t is_shared_page(page_table_entry_t* table, uint32_t vaddr) {
+    page_table_entry_t* pte = program_pte(table, vaddr);
+    if (!pte->present || !(pte->reserve_1 & PTE_SHARED))
+        return 0;
+    return pte->page_base_addr << SHIFT_4K;
 }
 
 /* 
@@ -128,11 +268,12 @@ void init_table_0() {
         page_table_0[i].page_base_addr = i;
     }
 
-    /* set video memory and three backup video pages to be present */ 
-    page_table_0[VIDEO >> SHIFT_4K].present = 1;
-    page_table_0[(VIDEO >> SHIFT_4K) + 1].present = 1;
-    page_table_0[(VIDEO >> SHIFT_4K) + 2].present = 1;
-    page_table_0[(VIDEO >> SHIFT_4K) + 3].present = 1;
+    /* set the whole VGA text window the screen scrolls through to be
+     * present, global since every address space maps it the same */ 
+    for (i = 0; i < VGA_PAGES; i++) {
+        page_table_0[(VIDEO >> SHIFT_4K) + i].present = 1;
+        page_table_0[(VIDEO >> SHIFT_4K) + i].global = 1;
+    }
 
     /* put the table into our directory */
     page_directory[0].present = 1;
@@ -141,106 +282,164 @@ void init_table_0() {
 }
 
 /*  
- * save_video_to_backup
- *   DESCRIPTION: save previous terminal's video memory to its backup page 
- *   INPUTS: int prev_id --- previous terminal id 
+ * map_time_page
+ *   DESCRIPTION: map the kernel's time page at TIME_PAGE_VIRTUAL_ADDR,
+ *                readable but not writable from user mode
+ *   INPUTS: table -- a 132MB-136MB page table
  *   OUTPUTS: none
  *   RETURN VALUE: none
  *   SIDE EFFECTS: none
  */
-void save_video_to_backup(int prev_id) {
-    memcpy((void *) (VIDEO + ((1 + prev_id) << SHIFT_4K)), (void *)VIDEO, (1 << SHIFT_4K));
+void map_time_page(page_table_entry_t* table) {
+    table[TIME_PAGE_INDEX].present = 1;
+    table[TIME_PAGE_INDEX].r_w = 0;
+    table[TIME_PAGE_INDEX].u_s = 1;
+    table[TIME_PAGE_INDEX].page_base_addr = (uint32_t)time_page_frame() >> SHIFT_4K;
 }
 
 /*  
- * restore_backup_to_video
- *   DESCRIPTION: restore video memory from the new terminal's video memory backup page
- *   INPUTS: int next_id --- new(current) terminal id 
+ * map_prog_vid_page
+ *   DESCRIPTION: map the 4KB user video page at 132MB into a process's own
+ *                directory, onto its terminal's RAM screen, which stays the
+ *                same page whichever terminal is displayed
+ *   INPUTS: dir -- the process's page directory
+ *           vid_table -- a free page to hold the 132MB-136MB table
+ *           term_id -- the process's terminal
  *   OUTPUTS: none
  *   RETURN VALUE: none
- *   SIDE EFFECTS: video memory(display) changes to reflect restoring
+ *   SIDE EFFECTS: none; the video entry was not present and the time page
+ *                 keeps its frame, so no tlb flush is needed
  */
-void restore_backup_to_video(int next_id) {
-    memcpy((void *)VIDEO, (void *) (VIDEO + ((1 + next_id) << SHIFT_4K)), (1 << SHIFT_4K));
+void map_prog_vid_page(page_dicr_entry_t* dir, page_table_entry_t* vid_table, int32_t term_id) {
+    memset(vid_table, 0, NUM_ENTRY * sizeof(page_table_entry_t));
+    map_time_page(vid_table);
+    vid_table[0].present = 1;
+    vid_table[0].r_w = 1;
+    vid_table[0].u_s = 1;
+    vid_table[0].page_base_addr = (uint32_t)screen_page(term_id) >> SHIFT_4K;
+
+    dir[PROG_VID_ENTRY].present = 1;
+    dir[PROG_VID_ENTRY].r_w = 1;
+    dir[PROG_VID_ENTRY].u_s = 1;
+    dir[PROG_VID_ENTRY].page_table_addr = (uint32_t)vid_table >> SHIFT_4K;
 }
 
 /*  
- * init_prog_vid
- *   DESCRIPTION: initialize a page table for text-mode video memory (not present yet)
+ * flush_tlb
+ *   DESCRIPTION: flush_tlb. Called after changing user mappings. Reloading
+ *                cr3 drops every entry except the global kernel ones
  *   INPUTS: none
  *   OUTPUTS: none
  *   RETURN VALUE: none
  *   SIDE EFFECTS: none
  */
-void init_prog_vid() {
-    /* How to setup? */
-    /* set every entry to be not present, read/write enabled, and user mode */
-    int i;
-    for (i = 0; i < NUM_ENTRY; i++) {
-        page_table_video[i].present = 0;
-        page_table_video[i].r_w = 1;
-        page_table_video[i].u_s = 1;
-        page_table_video[i].write_t = 0;
-        page_table_video[i].cache_dis = 0;
-        page_table_video[i].access = 0;
-        page_table_video[i].dirty = 0;
-        page_table_video[i].ptai = 0;
-        page_table_video[i].global = 0;
-        page_table_video[i].reserve_1 = 0;
-        page_table_video[i].page_base_addr = i;
-    }
+void flush_tlb() {
+    tlb_stats.full_flushes++;
+    asm (
+        "movl %cr3, %eax;"
+        "movl %eax, %cr3;"
+    );
+}
 
-     /* put the table into our directory */
-    page_directory[PROG_VID_ENTRY].present = 0;
-    page_directory[PROG_VID_ENTRY].r_w = 1;
-    page_directory[PROG_VID_ENTRY].u_s = 1;
-    page_directory[PROG_VID_ENTRY].page_table_addr = (unsigned int) page_table_video >> SHIFT_4K;
+/* 
+ * flush_tlb_page
+ *   DESCRIPTION: invalidate the tlb entry of one page with invlpg, keeping
+ *                the rest of the tlb
+ *   INPUTS: vaddr -- any address in the page
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void flush_tlb_page(uint32_t vaddr) {
+    tlb_stats.page_flushes++;
+    asm volatile ("invlpg (%0)" : : "r"(vaddr) : "memory");
+}
 
-    // set up the page for video memory
-    page_table_video[0].page_base_addr = VIDEO >> SHIFT_4K;
+/* 
+ * flush_tlb_range
+ *   DESCRIPTION: invalidate the tlb entries of the pages in [start, end),
+ *                page by page, or with one cr3 reload if the range is
+ *                longer than a batch
+ *   INPUTS: start -- first address
+ *           end -- address past the last page
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void flush_tlb_range(uint32_t start, uint32_t end) {
+    uint32_t vaddr;
+    start &= PAGE_MASK;
+    if (end <= start)
+        return;
+    if ((end - start) >> SHIFT_4K > TLB_BATCH_MAX) {
+        flush_tlb();
+        return;
+    }
+    for (vaddr = start; vaddr < end; vaddr += PAGE_SIZE)
+        flush_tlb_page(vaddr);
 }
 
-/*  
- * enable_prog_vid_page
- *   DESCRIPTION: enable the video memory page, then flush tlb
- *   INPUTS: none
+/* 
+ * tlb_batch_init
+ *   DESCRIPTION: start collecting pages whose entries change
+ *   INPUTS: batch -- batch to empty
  *   OUTPUTS: none
  *   RETURN VALUE: none
- *   SIDE EFFECTS: flush tlb
+ *   SIDE EFFECTS: none
  */
-void enable_prog_vid_page() {
-    page_directory[PROG_VID_ENTRY].present = 1;
-    page_table_video[0].present = 1;
-    flush_tlb();
+void tlb_batch_init(tlb_batch_t* batch) {
+    batch->count = 0;
 }
 
-/*  
- * disable_prog_vid_page
- *   DESCRIPTION: disable the video memory page, then flush tlb
- *   INPUTS: none
+/* 
+ * tlb_batch_add
+ *   DESCRIPTION: remember a page whose entry changed. Past TLB_BATCH_MAX
+ *                pages only the count grows, and the flush reloads cr3
+ *   INPUTS: batch -- batch to add to
+ *           vaddr -- any address in the page
  *   OUTPUTS: none
  *   RETURN VALUE: none
- *   SIDE EFFECTS: flush tlb
+ *   SIDE EFFECTS: none
  */
-void disable_prog_vid_page() {
-    page_directory[PROG_VID_ENTRY].present = 0;
-    page_table_video[0].present = 0;
-    flush_tlb();
+void tlb_batch_add(tlb_batch_t* batch, uint32_t vaddr) {
+    if (batch->count < TLB_BATCH_MAX)
+        batch->pages[batch->count] = vaddr & PAGE_MASK;
+    batch->count++;
 }
 
-/*  
- * flush_tlb
- *   DESCRIPTION: flush_tlb. Called after changing virtual memory mapping
- *   INPUTS: none
+/* 
+ * tlb_batch_flush
+ *   DESCRIPTION: invalidate every page of a batch at once, then empty it
+ *   INPUTS: batch -- batch to flush
  *   OUTPUTS: none
  *   RETURN VALUE: none
  *   SIDE EFFECTS: none
  */
-void flush_tlb() {
-    asm (
-        "movl %cr3, %eax;"
-        "movl %eax, %cr3;"
-    );
+void tlb_batch_flush(tlb_batch_t* batch) {
+    uint32_t i;
+    if (!batch->count)
+        return;
+    tlb_stats.batches++;
+    if (batch->count > TLB_BATCH_MAX)
+        flush_tlb();
+    else {
+        for (i = 0; i < batch->count; i++)
+            flush_tlb_page(batch->pages[i]);
+    }
+    batch->count = 0;
+}
+
+/* 
+ * print_tlb_stats
+ *   DESCRIPTION: print tlb invalidation counters
+ *   INPUTS: none
+ *   OUTPUTS: one line of counters
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void print_tlb_stats() {
+    printf("tlb: %u full flushes, %u page invalidations, %u batches\n",
+           tlb_stats.full_flushes, tlb_stats.page_flushes, tlb_stats.batches);
 }
 
 /* 
@@ -266,7 +465,9 @@ void load_page_directory(page_dicr_entry_t* addr) {
  *   INPUTS: none
  *   OUTPUTS: none
  *   RETURN VALUE: none
- *   SIDE EFFECTS: 1. set cr4 to allow mixture of page size, 2. set cr3 to enable paging
+ *   SIDE EFFECTS: 1. set cr4 to allow mixture of page size, 2. set cr0 to enable paging
+ *                 with write protection, 3. set cr4 to keep global pages in the
+ *                 tlb across cr3 loads
  */
 void enable_paging() {
     asm(
@@ -275,28 +476,15 @@ void enable_paging() {
         "orl $0x00000010, %eax;"
         "movl %eax, %cr4;"
 
-        // MSE: enable paging; LSE: enable protection mode
+        // MSE: enable paging; bit 16: kernel writes honour read-only
+        // pages too (copy-on-write); LSE: enable protection mode
         "movl %cr0, %eax;"
-        "orl $0x80000001, %eax;"
+        "orl $0x80010001, %eax;"
         "movl %eax, %cr0;"
-    );
-}
 
-/*  
- *change_prog_vid_mapping
- *   DESCRIPTION: change program user-access video memory mapping when process switch
- *     active terminal maps to real video memory page; inactive terminal maps to backup page
- *   INPUTS: int term_id --- current terminal id 
- *   OUTPUTS: none
- *   RETURN VALUE: none
- *   SIDE EFFECTS: flush tlb
- */
-void change_prog_vid_mapping(int32_t term_id) {
-    /*  active terminal maps to real video memory page */ 
-    if(term_id == active_term_idx)
-        page_table_video[0].page_base_addr = VIDEO >> SHIFT_4K;
-    /* inactive terminal maps to backup page */
-    else
-        page_table_video[0].page_base_addr = (VIDEO >> SHIFT_4K) + term_id + 1;
-    flush_tlb();
+        // PGE: kernel mappings marked global survive context switches
+        "movl %cr4, %eax;"
+        "orl $0x00000080, %eax;"
+        "movl %eax, %cr4;"
+    );
 }
@@ -9,9 +9,27 @@
 #define EIGHT_MB    0x800000
 
 #define PROG_VID_ENTRY 33
+/* the read-only time page, right after the vidmap page in the 132MB table */
+#define TIME_PAGE_INDEX 1
+#define TIME_PAGE_VIRTUAL_ADDR  0x08401000
+#define PROGRAM_PAGE_VIRTUAL_ADDR       0x08000000
 #define PROGRAM_DIRECTORY_VIRTUAL_ADDR  0x08048000
 
+#define PAGE_MASK       0xFFFFF000
+
+/* page fault error code bits */
+#define PF_PRESENT      0x1
+#define PF_WRITE        0x2
+#define PF_USER         0x4
+
+/* available bits 9 and 10 of a pte: frame belongs to the image cache,
+   and a write to it gets a private copy */
+#define PTE_SHARED      0x1
+#define PTE_COW         0x2
+
 #define VIDEO       0xB8000
+/* pages of the 32KB VGA text window */
+#define VGA_PAGES   8
 
 #define PD_1_ADDR   0x400
 #define SHIFT_4K    12
@@ -28,7 +46,7 @@ typedef struct page_dicr_entry {
     uint32_t access     :1;
     uint32_t reserve_0  :1;
     uint32_t page_size  :1;
-    uint32_t ignored    :1;
+    uint32_t global     :1;             // 4MB pages only, ignored for tables
     uint32_t reserve_1  :3;             // bit 9 - 11
     uint32_t page_table_addr   :20;     // bit 12 - 32
 } page_dicr_entry_t;
@@ -48,44 +66,87 @@ typedef struct page_table_entry{
     uint32_t page_base_addr   :20;     // bit 12 - 32
 } page_table_entry_t;
 
+/* pages collected by tlb_batch_add before a batch falls back to a full flush */
+#define TLB_BATCH_MAX   16
+
+/* page table updates whose tlb entries are invalidated together */
+typedef struct tlb_batch {
+    uint32_t count;
+    uint32_t pages[TLB_BATCH_MAX];
+} tlb_batch_t;
+
+/* tlb invalidation counters */
+typedef struct tlb_stats {
+    uint32_t full_flushes;      /* cr3 reloads, and PGE toggles */
+    uint32_t page_flushes;      /* single invlpg */
+    uint32_t batches;           /* tlb_batch_flush calls that invalidated anything */
+} tlb_stats_t;
+
+tlb_stats_t tlb_stats;
+
+/* boot directory, the template of every process's kernel half */
 page_dicr_entry_t page_directory[NUM_ENTRY] __attribute__((aligned(PAGE_SIZE)));
 /* page table: 0~4MB*/
 page_table_entry_t page_table_0[NUM_ENTRY] __attribute__((aligned(PAGE_SIZE)));
-/* page table: 128~132MB*/
-page_table_entry_t page_table_video[NUM_ENTRY] __attribute__((aligned(PAGE_SIZE)));
+/* page table: 132MB~136MB of processes without vidmap, only the time page */
+page_table_entry_t time_table[NUM_ENTRY] __attribute__((aligned(PAGE_SIZE)));
+
+/* 1: fill program pages on first touch, 0: copy the whole image at exec */
+int32_t demand_paging;
 
 /* initialize paging (driver function) */
 void init_paging();
 
-/* setup paging for a program */
-void setup_paging(int32_t prog_counter);
-
 /* initialize the page directory */
 void init_directory();
 
-/* enable a program page */
-void enable_program_page(int32_t prog_counter);
+/* set up a process's page directory around its program page table */
+void init_page_directory(page_dicr_entry_t* dir, page_table_entry_t* table);
+
+/* mark every page of a program's 128MB-132MB region not present, freeing its frames */
+void clear_program_pages(page_table_entry_t* table, tlb_batch_t* batch);
+
+/* back one 4KB program page with a frame of the process's own */
+int32_t map_program_page(page_table_entry_t* table, uint32_t vaddr, uint32_t r_w);
+
+/* map one program page read-only onto a shared frame */
+void map_shared_page(page_table_entry_t* table, uint32_t vaddr, uint32_t frame, uint32_t cow);
+
+/* whether a write to a program page should copy it */
+int32_t is_cow_page(page_table_entry_t* table, uint32_t vaddr);
+
+/* shared frame behind a program page, 0 if none */
+uint32_t is_shared_page(page_table_entry_t* table, uint32_t vaddr);
 
 /* initialize the page table 0 */
 void init_table_0();
 
-/* save previous terminal's video memory to its backup page */
-void save_video_to_backup(int prev_id);
+/* map the time page read-only for user code into a 132MB-136MB table */
+void map_time_page(page_table_entry_t* table);
+
+/* map the user video page into a process's directory */
+void map_prog_vid_page(page_dicr_entry_t* dir, page_table_entry_t* vid_table, int32_t term_id);
 
-/* restore video memory from the new terminal's video memory backup page */
-void restore_backup_to_video(int next_id);
+/* flush_tlb. Called after changing user mappings, keeps global kernel entries */
+void flush_tlb();
 
-/* initialize video memory page */
-void init_prog_vid();
+/* invalidate the tlb entry of one page */
+void flush_tlb_page(uint32_t vaddr);
 
-/* enable video memory page */
-void enable_prog_vid_page();
+/* invalidate the tlb entries of the pages in [start, end) */
+void flush_tlb_range(uint32_t start, uint32_t end);
 
-/* disable video memory page */
-void disable_prog_vid_page();
+/* start collecting pages to invalidate */
+void tlb_batch_init(tlb_batch_t* batch);
 
-/* flush_tlb. Called after changing virtual memory mapping */
-void flush_tlb();
+/* add a page whose entry changed to a batch */
+void tlb_batch_add(tlb_batch_t* batch, uint32_t vaddr);
+
+/* invalidate every page of a batch and empty it */
+void tlb_batch_flush(tlb_batch_t* batch);
+
+/* print tlb invalidation counters */
+void print_tlb_stats();
 
 /* load page directory address to cr3 */
 void load_page_directory(page_dicr_entry_t* addr);
@@ -93,7 +154,4 @@ void load_page_directory(page_dicr_entry_t* addr);
 /* enable paging with mixtured page sizes */
 void enable_paging();
 
-/* Change the program video mem mapping */
-void change_prog_vid_mapping(int32_t term_id);
-
 #endif
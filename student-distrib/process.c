@@ -3,53 +3,229 @@
 #include "lib.h"
 #include "system_call.h"
 #include "scheduling.h"
+#include "paging.h"
+#include "page_alloc.h"
+#include "slab.h"
+#include "rtc.h"
+#include "timer.h"
 
 #define FILE_ARR_LENGTH 8
 #define STD_RANGE       2
-#define MAX_PID         5
+#define PID_WORDS       (PID_MAX / 32)
+
+/* pcb + kernel stack objects, four per 32KB slab */
+#define PCB_SLAB_ORDER  3
+/* file arrays of 8 x 20 bytes, 25 per page */
+#define FILES_ALIGN     16
+
+/* bit set: pid is free */
+static uint32_t pid_free_map[PID_WORDS];
+/* bit w set: pid_free_map[w] has a free pid */
+static uint32_t pid_summary;
+
+static kmem_cache_t pcb_cache;
+static kmem_cache_t files_cache;
+
+/* a halted process whose kernel stack was still in use when it exited */
+static pcb_t* zombie_pcb;
 
 /* 
- * init_prog
- *   DESCRIPTION: initialize program counter and exception flag to 0
+ * pid_alloc
+ *   DESCRIPTION: take the lowest free pid with two bsf, so the cost does
+ *                not depend on how many pids are in use
  *   INPUTS: none
  *   OUTPUTS: none
+ *   RETURN VALUE: pid, -1 if all PID_MAX pids are taken
+ *   SIDE EFFECTS: none
+ */
+static int32_t pid_alloc() {
+    uint32_t word, bit;
+    if (!pid_summary)
+        return -1;
+    word = bsf(pid_summary);
+    bit = bsf(pid_free_map[word]);
+    pid_free_map[word] &= ~(1 << bit);
+    if (!pid_free_map[word])
+        pid_summary &= ~(1 << word);
+    return word * 32 + bit;
+}
+
+/* 
+ * pid_release
+ *   DESCRIPTION: give a pid back to the bitmap
+ *   INPUTS: pid -- pid from pid_alloc
+ *   OUTPUTS: none
  *   RETURN VALUE: none
  *   SIDE EFFECTS: none
  */
+static void pid_release(int32_t pid) {
+    pid_free_map[pid / 32] |= 1 << (pid % 32);
+    pid_summary |= 1 << (pid / 32);
+}
+
+/* 
+ * init_prog
+ *   DESCRIPTION: initialize program counter and exception flag to 0, the
+ *                pid allocator, the pcb and file array caches and kmalloc
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: initializes the page allocator
+ */
 void init_prog() {
     prog_counter = 0;
     program_exception_flag = 0;
-    int32_t count = 0;
-    int32_t base_pcb = PROG0_KSTACK_BOTTOM - KERNEL_STACK_SIZE;
-    pcb_t* cur_pcb = NULL;
-    /* initalize all 6 pcbs*/
-    for(count = 0; count <= MAX_PID; count++){
-        cur_pcb = (pcb_t*)(base_pcb - count * KERNEL_STACK_SIZE);
-        cur_pcb -> status = 0;
-        cur_pcb -> video_mem_flag = 0;
+
+    init_page_alloc();
+    kmem_cache_init(&pcb_cache, "pcb", KERNEL_STACK_SIZE, KERNEL_STACK_SIZE, PCB_SLAB_ORDER);
+    kmem_cache_init(&files_cache, "files", FILE_NUM * sizeof(file_abs_entry_t), FILES_ALIGN, 0);
+    kmalloc_init();
+    memset(pid_free_map, 0xFF, sizeof(pid_free_map));
+    pid_summary = (PID_WORDS == 32) ? 0xFFFFFFFF : (1 << PID_WORDS) - 1;
+    memset(pid_table, 0, sizeof(pid_table));
+    zombie_pcb = NULL;
+}
+
+/* 
+ * alloc_pcb
+ *   DESCRIPTION: allocate a pcb with its kernel stack from pcb_cache, a pid,
+ *                a file array, an empty program page table and a page
+ *                directory
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: pcb with pid, prog_table and bookkeeping fields set,
+ *                 NULL if out of pids or memory
+ *   SIDE EFFECTS: registers the pcb in pid_table
+ */
+pcb_t* alloc_pcb() {
+    pcb_t* pcb;
+    int32_t pid = pid_alloc();
+    if (pid == -1)
+        return NULL;
+
+    if ((pcb = (pcb_t*)kmem_cache_alloc(&pcb_cache)) == NULL) {
+        pid_release(pid);
+        return NULL;
+    }
+    if ((pcb->file_array = (file_abs_entry_t*)kmem_cache_alloc(&files_cache)) == NULL) {
+        kmem_cache_free(&pcb_cache, pcb);
+        pid_release(pid);
+        return NULL;
+    }
+    if ((pcb->prog_table = (page_table_entry_t*)page_alloc(0)) == NULL) {
+        kmem_cache_free(&files_cache, pcb->file_array);
+        kmem_cache_free(&pcb_cache, pcb);
+        pid_release(pid);
+        return NULL;
+    }
+    if ((pcb->page_dir = (page_dicr_entry_t*)page_alloc(0)) == NULL) {
+        page_free((uint32_t)pcb->prog_table, 0);
+        kmem_cache_free(&files_cache, pcb->file_array);
+        kmem_cache_free(&pcb_cache, pcb);
+        pid_release(pid);
+        return NULL;
+    }
+    memset(pcb->prog_table, 0, PAGE_SIZE);
+    init_page_directory(pcb->page_dir, pcb->prog_table);
+
+    pcb->pid = pid;
+    pcb->status = 0;
+    pcb->thread.esp = 0;
+    pcb->thread.eip = 0;
+    pcb->thread.cr3 = (uint32_t)pcb->page_dir;
+    pcb->vid_table = NULL;
+    pcb->exec_image = NULL;
+    pcb->exec_start_tsc = 0;
+    pcb->wait_next = NULL;
+    pcb->run_next = NULL;
+    pcb->run_prev = NULL;
+    pid_table[pid] = pcb;
+    return pcb;
+}
+
+/* 
+ * release_pcb_mm
+ *   DESCRIPTION: free everything a pcb holds except the pcb and its kernel
+ *                stack: program frames, page tables, page directory, file
+ *                array and pid
+ *   INPUTS: pcb -- pcb from alloc_pcb, whose directory is not in cr3
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void release_pcb_mm(pcb_t* pcb) {
+    clear_program_pages(pcb->prog_table, NULL);
+    page_free((uint32_t)pcb->prog_table, 0);
+    if (pcb->vid_table != NULL) {
+        page_free((uint32_t)pcb->vid_table, 0);
+        terminals[pcb->term_idx].vidmap_users--;
     }
+    page_free((uint32_t)pcb->page_dir, 0);
+    kmem_cache_free(&files_cache, pcb->file_array);
+    pid_table[pcb->pid] = NULL;
+    pid_release(pcb->pid);
+}
+
+/* 
+ * free_pcb
+ *   DESCRIPTION: free a process's program frames, page tables, page
+ *                directory, file array, pid, and pcb
+ *   INPUTS: pcb -- pcb from alloc_pcb, whose directory is not in cr3 and
+ *                  whose kernel stack we are not on
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void free_pcb(pcb_t* pcb) {
+    release_pcb_mm(pcb);
+    kmem_cache_free(&pcb_cache, pcb);
+}
+
+/* 
+ * exit_pcb
+ *   DESCRIPTION: free a halting process from its own kernel stack. All but
+ *                the pcb goes now; the pcb and the stack under us are kept
+ *                as the zombie until reap_zombie runs on another stack
+ *   INPUTS: pcb -- the current process, whose directory is not in cr3
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: frees the previous zombie, which we cannot be running on
+ */
+void exit_pcb(pcb_t* pcb) {
+    reap_zombie();
+    release_pcb_mm(pcb);
+    zombie_pcb = pcb;
+}
+
+/* 
+ * reap_zombie
+ *   DESCRIPTION: give the last halted process's pcb and kernel stack back
+ *                to pcb_cache, once we are off that stack
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void reap_zombie() {
+    if (zombie_pcb == NULL || zombie_pcb == current)
+        return;
+    kmem_cache_free(&pcb_cache, zombie_pcb);
+    zombie_pcb = NULL;
 }
 
 /* 
  * create_pcb
  *   DESCRIPTION: create a program control block for a program
- *   INPUTS: none
+ *   INPUTS: term -- terminal the program runs on
  *   OUTPUTS: none
- *   RETURN VALUE: 0 if successful
+ *   RETURN VALUE: pid if successful
  *                 -1 if not
  *   SIDE EFFECTS: none
  */
-int32_t create_pcb() {
-    if (prog_counter > MAX_PID) 
-        return -1;
-
-    /* pid is the pid of next active pcb */
-    /* pcb is the pointer to next active pcb */
-    int32_t pid = -1;
-    pcb_t* pcb = get_active_pcb(&pid);
+int32_t create_pcb(int32_t term) {
+    pcb_t* pcb = alloc_pcb();
     if (pcb == NULL)
         return -1;
-    pcb->pid = pid;
     /* set up file array: STDIN, STDOUT */
     int i;
     for (i = 0; i < FILE_ARR_LENGTH; i++) {
@@ -59,51 +235,41 @@ int32_t create_pcb() {
         } else
             pcb->file_array[i].flags = 0;
         pcb->file_array[i].file_position = 0;
+        pcb->file_array[i].private_data = NULL;
     }
 
     /* link to parent process */
-    if (terminals[cur_term_id].term_prog_counter == 0)
+    if (terminals[term].term_prog_counter == 0)
         pcb->parent_pcb_pointer = NULL;
-    else {
-        uint32_t parent_pid = terminals[cur_term_id].prog_pids[terminals[cur_term_id].term_prog_counter - 1];
-        pcb->parent_pcb_pointer = (pcb_t*) (PROG0_KSTACK_BOTTOM - (parent_pid + 1) * KERNEL_STACK_SIZE);
-    }
+    else
+        pcb->parent_pcb_pointer = FIND_PCB(terminals[term].top_pid);
     pcb->status = 1;
-    pcb->term_idx = cur_term_id; 
+    pcb->term_idx = term; 
     prog_counter++;
     /* switch file_array to point to the new process's file array */
     file_array = pcb->file_array;
 
     /* change terminal attributes*/
-    int term_prog_idx = terminals[cur_term_id].term_prog_counter;
-    terminals[cur_term_id].prog_pids[term_prog_idx] = pcb -> pid;
-    terminals[cur_term_id].term_prog_counter ++;
+    terminals[term].top_pid = pcb->pid;
+    terminals[term].term_prog_counter ++;
 
-    return pid;
+    return pcb->pid;
 }
 
 /* 
- * get_active_pcb
- *   DESCRIPTION: get the current program's pcb
- *   INPUTS: int *pid -- pid passed by pointer to be modified
- *   OUTPUTS: none
- *   RETURN VALUE: address of current pcb
- *   SIDE EFFECTS: *pid is filled with the pid of found pcb
+ * print_process_stats
+ *   DESCRIPTION: print process, memory allocator, RTC and timer counters
+ *   INPUTS: none
+ *   OUTPUTS: counters to the screen
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
  */
-pcb_t* get_active_pcb(int32_t *pid){
-    if(prog_counter > MAX_PID) return 0;
-    int32_t base_pcb = PROG0_KSTACK_BOTTOM - KERNEL_STACK_SIZE;
-    pcb_t* cur_pcb = NULL;
-    int32_t count = 0;
-    /* iterate over 6 pcbs until find an empty pcb */
-    for(count = 0; count <= MAX_PID; count++){
-        cur_pcb = (pcb_t*)(base_pcb - count * KERNEL_STACK_SIZE);
-        if(cur_pcb -> status == 0){
-            *pid = count;
-            return cur_pcb;
-        }
-    }
-    return 0;
+void print_process_stats() {
+    printf("processes: %d running\n", prog_counter);
+    print_slab_stats();
+    print_page_stats();
+    print_rtc_stats();
+    print_timer_stats();
 }
 
 /* 
@@ -113,11 +279,12 @@ pcb_t* get_active_pcb(int32_t *pid){
  *           cs -- code segment
  *           esp -- stack pointer to jump
  *           ss -- stack segment
+ *           pcb -- the process being started, whose kernel stack traps use
  *   OUTPUTS: none
  *   RETURN VALUE: none
  *   SIDE EFFECTS: none
  */
-void context_switch(uint32_t eip, uint32_t cs, uint32_t esp, uint32_t ss){  
+void context_switch(uint32_t eip, uint32_t cs, uint32_t esp, uint32_t ss, pcb_t* pcb){  
     /*
         old ebp <--- ebp
         ret addr
@@ -129,9 +296,7 @@ void context_switch(uint32_t eip, uint32_t cs, uint32_t esp, uint32_t ss){
 
     //Prepare the stack for the "iret instruction"
     //Push SS, ESP, EFLAGS, CS, EIP
-    uint32_t term_prog_num = terminals[cur_term_id].term_prog_counter;
-    uint32_t new_proc_pid = terminals[cur_term_id].prog_pids[term_prog_num - 1];
-    tss.esp0 = PROG0_KSTACK_BOTTOM - KERNEL_STACK_SIZE * new_proc_pid;
+    tss.esp0 = KSTACK_TOP(pcb);
     tss.ss0 = KERNEL_DS;
 
    /* orl $0x200 to set IF flag */
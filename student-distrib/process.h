@@ -7,9 +7,19 @@
 #define STDOUT 1
 
 #define USER_STACK_BOTTOM 0xC00000
-#define PROG0_KSTACK_BOTTOM 0x800000
-#define PROG1_KSTACK_BOTTOM 0x7FE000   
 #define KERNEL_STACK_SIZE    0x2000
+
+/* offsets into thread_t, for switch_to */
+#define THREAD_ESP  0
+#define THREAD_EIP  4
+#define THREAD_CR3  8
+
+#ifndef ASM
+
+#include "elf.h"
+
+/* pids handed out by the bitmap allocator, 32 per bitmap word */
+#define PID_MAX     1024
 #define FILE_NUM 8 
 #define PARAMS_LEN 128
 
@@ -27,19 +37,30 @@ typedef struct file_abs_entry
     /* points to the operation table of this file */
     file_op_table_t* op_ptr;
     uint32_t inode_idx;
-    /* track which char to read next for common files 
-       or store frequency ration for rtc file*/
+    /* track which char to read next for common files */
     uint32_t file_position;
     /* alive or dead */
     uint32_t flags;
+    /* per-descriptor driver state, e.g. the rtc's vrtc_t, NULL if none */
+    void* private_data;
 } file_abs_entry_t;
 
+/* kernel context saved by switch_to; callee-saved registers are on the stack */
+typedef struct thread {
+    uint32_t esp;
+    uint32_t eip;
+    /* page directory loaded while the process runs */
+    uint32_t cr3;
+} thread_t;
+
 /* process control block */
 typedef struct pcb{
+    /* switch_to context, must stay first: switch_to addresses it by offset */
+    thread_t thread;
     /* store ebp for execute and halt */
     int32_t ebp;
-    /* file_array of process-access files */
-    file_abs_entry_t file_array[FILE_NUM];
+    /* file_array of process-access files, FILE_NUM entries from files_cache */
+    file_abs_entry_t* file_array;
     /* running or dead */
     int32_t status;
     /* process identifier */
@@ -50,10 +71,23 @@ typedef struct pcb{
     uint8_t params[PARAMS_LEN]; 
     /* which terminal is this process running */
     uint32_t term_idx;
-    /* store ebp for scheduling */
-    int32_t term_ebp;
-    /* acquire user video memory? */
-    int32_t video_mem_flag;
+    /* executable image, for filling program pages on demand */
+    program_info_t exec;
+    /* shared image cache entry, NULL if the image is loaded privately */
+    struct image* exec_image;
+    /* 128MB-132MB page table, from the page allocator */
+    struct page_table_entry* prog_table;
+    /* own page directory, its kernel half shared with every process */
+    struct page_dicr_entry* page_dir;
+    /* 132MB-136MB table holding the vidmap page, NULL until vidmap */
+    struct page_table_entry* vid_table;
+    /* tsc at execute, 0 once the first instruction has been reached */
+    uint64_t exec_start_tsc;
+    /* next process sleeping on the same wait queue */
+    struct pcb* wait_next;
+    /* run queue links, NULL while blocked, waiting for a child or dead */
+    struct pcb* run_next;
+    struct pcb* run_prev;
 } pcb_t;
 
 /* Where should we place the file descriptor array (for each task)? */
@@ -64,22 +98,58 @@ file_abs_entry_t* file_array;
 /* a global program counter: how many processes are running in total */
 int32_t prog_counter;
 
+/* pid -> pcb of every live process, NULL for free pids */
+pcb_t* pid_table[PID_MAX];
+
+/* top of a pcb's kernel stack, for tss.esp0 */
+#define KSTACK_TOP(pcb)     ((uint32_t)(pcb) + KERNEL_STACK_SIZE)
+
+/* 
+ * get_current_pcb
+ *   DESCRIPTION: pcb of the running process. The pcb sits at the bottom of
+ *                the 8KB-aligned object holding its kernel stack, so masking
+ *                esp finds it; only valid on a process's kernel stack
+ *   RETURN VALUE: pcb whose kernel stack we are on
+ */
+static inline pcb_t* get_current_pcb(void) {
+    uint32_t esp;
+    asm volatile ("movl %%esp, %0" : "=r"(esp));
+    return (pcb_t*)(esp & ~(KERNEL_STACK_SIZE - 1));
+}
+
+#define current     get_current_pcb()
+
 /* a kernel file array, 8 is the number of files */
 file_abs_entry_t kernel_file_array[8];
 
 /* initialize program counter to 0 */
 void init_prog();
 
-/* initialize a program's pcb */
-int32_t create_pcb();
+/* initialize a program's pcb on a terminal */
+int32_t create_pcb(int32_t term);
+
+/* allocate a pcb, its kernel stack, pid and program page table */
+pcb_t* alloc_pcb();
+
+/* free everything alloc_pcb and the program's pages took */
+void free_pcb(pcb_t* pcb);
 
-/* get the current pcb */
-pcb_t* get_active_pcb(int32_t *pcb);
+/* free a halting process, keeping its kernel stack until reap_zombie */
+void exit_pcb(pcb_t* pcb);
+
+/* free the kernel stack of the last halted process once we are off it */
+void reap_zombie();
+
+/* print process allocator counters */
+void print_process_stats();
 
 /* prepare and switch a user level program */
-void context_switch(uint32_t eip, uint32_t cs, uint32_t esp, uint32_t ss);
+void context_switch(uint32_t eip, uint32_t cs, uint32_t esp, uint32_t ss, pcb_t* pcb);
+
+/* save prev's kernel context and resume next's, in switch.S */
+extern void switch_to(pcb_t* prev, pcb_t* next);
 
-/* pcb & kernel stack structure
+/* pcb & kernel stack structure, one 8KB-aligned object of pcb_cache
     ------------------------------
         | process control block |
 8kb     |-----------------------|
@@ -91,5 +161,6 @@ void context_switch(uint32_t eip, uint32_t cs, uint32_t esp, uint32_t ss);
 ----------------------------------
 */
 
+#endif /* ASM */
 #endif
 
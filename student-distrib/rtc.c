@@ -2,15 +2,28 @@
 #include "lib.h"
 #include "i8259.h"
 #include "process.h"
+#include "waitqueue.h"
+#include "slab.h"
 
 
 
 /* set RTC_TEST_ENABLE to enable the test_interrupts() */
 #define RTC_TEST_ENABLE     0
-#define ratio file_position
 
 volatile int rtc_counter_global = 0;
-volatile int rtc_exe_flag = 1;
+/* RTCs with a reader waiting, soonest deadline first */
+static vrtc_t* timer_queue;
+/* every open RTC */
+static vrtc_t* vrtc_list;
+/* open virtual RTCs at each frequency level */
+static uint32_t rtc_level_users[RTC_FREQ_LEVELS];
+/* rtc_counter_global units per physical interrupt */
+static uint32_t rtc_tick_step;
+/* interrupts and handler cycles in the RTC second being counted */
+static uint32_t sec_irqs;
+static uint32_t sec_cycles;
+/* rtc_counter_global value that ends that second */
+static int sec_end;
 
 /* 
  * rtc_handler
@@ -18,15 +31,26 @@ volatile int rtc_exe_flag = 1;
  *   INPUTS: none
  *   OUTPUTS: none
  *   RETURN VALUE: none
- *   SIDE EFFECTS: 1. print a counter (DEBUG), 2. test interrupts
+ *   SIDE EFFECTS: 1. advance the counter, wake due readers, 2. test interrupts
  *                 3. safeguard register C, 4. send eoi to port 8 (for rtc)
+ *                 5. count the interrupt and its cycles in rtc_stats
  */
 void rtc_handler(){
+    uint64_t start = rdtsc();
+    uint32_t cycles;
+    vrtc_t* v;
     //Re-enable the interrupt
-    /* increment rtc counter every time a physical interrupt is received */
-    rtc_counter_global++;
-    /* rtc interrupt has not been handled by task*/
-    rtc_exe_flag = 1;
+    /* advance by one physical period, in 1 / MAX_RTC_FREQ s units */
+    rtc_counter_global += rtc_tick_step;
+    /* wake exactly the readers whose virtual interrupt is due */
+    while (timer_queue && rtc_counter_global - timer_queue->deadline >= 0) {
+        v = timer_queue;
+        timer_queue = v->timer_next;
+        v->timer_next = NULL;
+        v->fired = 1;
+        v->fired_tsc = start;
+        wake_up(&v->wait);
+    }
 
     #if (RTC_TEST_ENABLE == 1)
     test_interrupts();
@@ -38,6 +62,132 @@ void rtc_handler(){
     
     /* send eoi to port 8 */
     send_eoi(RTC_PIC);
+
+    cycles = (uint32_t)(rdtsc() - start);
+    rtc_stats.interrupts++;
+    rtc_stats.handler_cycles += cycles;
+    sec_irqs++;
+    sec_cycles += cycles;
+    /* a whole RTC second has passed: publish its counts */
+    if (rtc_counter_global - sec_end >= 0) {
+        rtc_stats.irqs_per_sec = sec_irqs;
+        rtc_stats.cycles_per_sec = sec_cycles;
+        sec_irqs = 0;
+        sec_cycles = 0;
+        sec_end += MAX_RTC_FREQ;
+    }
+}
+
+/* 
+ * rtc_update_rate
+ *   DESCRIPTION: program the slowest periodic rate that still ticks at
+ *                the highest frequency any open virtual RTC asked for, or
+ *                mask IRQ 8 if no virtual RTC is open
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: may reprogram register A and (un)mask IRQ 8
+ */
+static void rtc_update_rate() {
+    uint32_t flags;
+    uint32_t freq = 0;
+    int32_t level;
+
+    for (level = RTC_FREQ_LEVELS - 1; level >= 0; level--) {
+        if (rtc_level_users[level]) {
+            freq = 1 << level;
+            break;
+        }
+    }
+    if (freq && freq < MIN_RTC_PHYS_FREQ)
+        freq = MIN_RTC_PHYS_FREQ;
+    if (freq == rtc_stats.phys_freq)
+        return;
+
+    cli_and_save(flags);
+    if (freq == 0) {
+        disable_irq(RTC_PIC);
+        rtc_stats.irqs_per_sec = 0;
+        rtc_stats.cycles_per_sec = 0;
+    } else {
+        /* freq = 32768 >> (rate - 1), freq is a power of two */
+        set_rtc_freq(16 - bsf(freq));
+        rtc_tick_step = MAX_RTC_FREQ / freq;
+        if (rtc_stats.phys_freq == 0) {
+            /* drop an interrupt left pending when it was masked, or the
+               chip would never raise another one */
+            outb(REG_C, RTC_STATUS);
+            inb(RTC_DATA);
+            sec_irqs = 0;
+            sec_cycles = 0;
+            sec_end = rtc_counter_global + MAX_RTC_FREQ;
+            enable_irq(RTC_PIC);
+        }
+    }
+    rtc_stats.phys_freq = freq;
+    rtc_stats.rate_changes++;
+    restore_flags(flags);
+}
+
+/* 
+ * print_rtc_stats
+ *   DESCRIPTION: print the physical RTC counters and those of every
+ *                open RTC
+ *   INPUTS: none
+ *   OUTPUTS: counters to the screen
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void print_rtc_stats() {
+    vrtc_t* v;
+    printf("rtc: %u open, %u Hz, %u rate changes\n",
+        rtc_stats.open, rtc_stats.phys_freq, rtc_stats.rate_changes);
+    printf("rtc: %u interrupts, %u cycles each, last second %u interrupts %u cycles\n",
+        rtc_stats.interrupts,
+        rtc_stats.interrupts ? (uint32_t)div_u64_u32(rtc_stats.handler_cycles, rtc_stats.interrupts, NULL) : 0,
+        rtc_stats.irqs_per_sec, rtc_stats.cycles_per_sec);
+    for (v = vrtc_list; v != NULL; v = v->next) {
+        printf("rtc fd %d: %u Hz, %u reads, %u missed, jitter avg %u max %u cycles\n",
+            v->fd, MAX_RTC_FREQ / v->period, v->reads, v->missed,
+            v->reads ? (uint32_t)div_u64_u32(v->jitter_cycles, v->reads, NULL) : 0,
+            v->max_jitter);
+    }
+}
+
+/* 
+ * timer_insert
+ *   DESCRIPTION: queue an RTC for rtc_handler by its deadline, interrupts
+ *                must be off
+ *   INPUTS: v -- the RTC, not already queued
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: links v into timer_queue
+ */
+static void timer_insert(vrtc_t* v) {
+    vrtc_t** link = &timer_queue;
+    /* after every RTC due no later, so equal deadlines wake in order */
+    while (*link && v->deadline - (*link)->deadline >= 0)
+        link = &(*link)->timer_next;
+    v->timer_next = *link;
+    *link = v;
+}
+
+/* 
+ * timer_remove
+ *   DESCRIPTION: take an RTC off the timer queue if it is on it,
+ *                interrupts must be off
+ *   INPUTS: v -- the RTC
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: unlinks v from timer_queue
+ */
+static void timer_remove(vrtc_t* v) {
+    vrtc_t** link = &timer_queue;
+    while (*link && *link != v)
+        link = &(*link)->timer_next;
+    if (*link)
+        *link = v->timer_next;
+    v->timer_next = NULL;
 }
 
 
@@ -48,6 +198,7 @@ void rtc_handler(){
  *   OUTPUTS: none
  *   RETURN VALUE: none
  *   SIDE EFFECTS: 1. select register B and enable interrupt
+ *                 IRQ 8 stays masked until a virtual RTC is opened
  */
 void rtc_init(){
     char prev;
@@ -62,8 +213,9 @@ void rtc_init(){
     outb(REG_B, RTC_STATUS);
     outb(prev | 0x40, RTC_DATA);
     
-    //Init with the highest freq
-    set_rtc_freq(3);    // value 3 for highest freq
+    /* the rate is programmed by rtc_update_rate once an RTC is opened */
+    timer_queue = NULL;
+    vrtc_list = NULL;
     // Remember to read from register C at the end of
     // RTC handler code to get another interrupt
     // rtc_counter_global = 0;
@@ -97,14 +249,17 @@ void set_rtc_freq(char rate){
 
 /* 
  * rtc_read
- *   DESCRIPTION: force the program to wait until next virtual rtc interrupt
- *   INPUTS:  v_rtc: a virtual rtc struct associated with the current task
+ *   DESCRIPTION: put the program to sleep until next virtual rtc interrupt.
+ *                Virtual interrupts come every period from the first read
+ *                after open or write; one that passed before this read is
+ *                counted as missed rather than returned at once
+ *   INPUTS:  fd: file descriptor of the rtc
  *              buf: unused
              nbytes: unused
  *   OUTPUTS: none
  *   RETURN VALUE: 0 on success
-*                 -1 on invalid v_rtc
- *   SIDE EFFECTS: none
+*                 -1 on invalid fd
+ *   SIDE EFFECTS: updates the RTC's deadline and counters
  */
 int32_t rtc_read(int32_t fd, void* buf, int32_t nbytes) {
     buf = buf;
@@ -112,34 +267,49 @@ int32_t rtc_read(int32_t fd, void* buf, int32_t nbytes) {
     /* failure: invalid fd */
     /* valid array range: 2-7 */
     if (fd < 2 || fd > 7) return -1;
-    /* wait until next physical rtc interrupt */
-    sti();
-    while(!rtc_exe_flag);
-    cli();
-    /* 3 is the total terminal number */
-    int div = (file_array[fd].ratio / 3);
-    if(!div)
-        div = 1;
-    /* wait until next virtual rtc interrupt */
-    sti();
-    while(rtc_counter_global % div);
-    cli();
-    /* rtc interrupt is received */
-    rtc_exe_flag = 0;
+    vrtc_t* v = file_array[fd].private_data;
+    uint32_t flags;
+    uint32_t jitter;
+    int late;
+    int missed;
 
+    cli_and_save(flags);
+    if (!v->armed) {
+        v->deadline = rtc_counter_global + v->period;
+        v->armed = 1;
+    } else if ((late = rtc_counter_global - v->deadline) >= 0) {
+        /* the reader came back after its virtual interrupt: skip to the
+         * next one still ahead */
+        missed = late / v->period + 1;
+        v->missed += missed;
+        v->deadline += missed * v->period;
+    }
+    v->fired = 0;
+    timer_insert(v);
+    wait_event(&v->wait, v->fired);
+    restore_flags(flags);
+
+    jitter = (uint32_t)(rdtsc() - v->fired_tsc);
+    v->jitter_cycles += jitter;
+    if (jitter > v->max_jitter)
+        v->max_jitter = jitter;
+    v->reads++;
+    v->deadline += v->period;
     return 0;
 }
 
 /* 
  * rtc_write
  *   DESCRIPTION: change the RTC interrupt frequency(virtual)
- *   INPUTS:  v_rtc: a virtual rtc struct associated with the current task
+ *   INPUTS:  fd: file descriptor of the rtc
  *              buf: a pointer to the desired frequency in Hz
              nbytes: the length of buf
  *   OUTPUTS: none
  *   RETURN VALUE: 0 on success
- *                 -1 on invalid v_rtc, invalid frequency or invalid nbytes
- *   SIDE EFFECTS: change the virtual rtc interrupt frequency of current task
+ *                 -1 on invalid fd, invalid frequency or invalid nbytes
+ *   SIDE EFFECTS: change the virtual rtc interrupt frequency of this
+ *                 descriptor, and the physical rate if needed. The next
+ *                 read waits one new period
  */
 int32_t rtc_write(int32_t fd, const void* buf, int32_t nbytes) {
     /* check if buffer and nbytes are valid */
@@ -147,49 +317,84 @@ int32_t rtc_write(int32_t fd, const void* buf, int32_t nbytes) {
     /* failure: invalid fd */
     /* valid array range: 2-7 */
     if (fd < 2 || fd > 7) return -1;
+    vrtc_t* v = file_array[fd].private_data;
     uint32_t freq = *(uint32_t *)buf; 
     /* check if frequency is valid */
     //freq & (freq - 1) == 0 to check power of two
-    if((freq & (freq-1)) != 0 || freq > MAX_RTC_FREQ) return -1;
+    if(freq == 0 || (freq & (freq-1)) != 0 || freq > MAX_RTC_FREQ) return -1;
     
-    /* derive ratio from frequency */
-    /* ratio is relative to the maximum freq of RTC */
-    file_array[fd].ratio = MAX_RTC_FREQ / freq;
+    /* move this RTC to its new frequency level */
+    rtc_level_users[bsf(MAX_RTC_FREQ / v->period)]--;
+    rtc_level_users[bsf(freq)]++;
+    /* period is relative to the maximum freq of RTC */
+    v->period = MAX_RTC_FREQ / freq;
+    v->armed = 0;
+    rtc_update_rate();
     return 0;
 }
 
 /* 
  * rtc_open
  *   DESCRIPTION: open and initialize the rtc 
- *   INPUTS:  filename: the file name of rtc
- *               v_rtc: a virtual rtc struct associated with the current task
+ *   INPUTS:  fd: file descriptor being opened
  *   OUTPUTS: none
  *   RETURN VALUE:  0 on success
- *                 -1 on invalid v_rtc, invalid filename or rtc file not found
- *   SIDE EFFECTS: initialize the virtual rtc interrupt frequency to 2Hz
+ *                 -1 on invalid fd or no memory for the RTC
+ *   SIDE EFFECTS: initialize the virtual rtc interrupt frequency to 2Hz,
+ *                 unmask IRQ 8 for the first open RTC
  */
 int32_t rtc_open(int32_t fd) {
     /* failure: invalid fd */
     /* valid array range: 2-7 */
     if (fd < 2 || fd > 7) return -1;
+    vrtc_t* v = kmalloc(sizeof(vrtc_t));
+    if (v == NULL)
+        return -1;
+    memset(v, 0, sizeof(vrtc_t));
+    v->fd = fd;
+    /* write virual rtc interrupt frequency */
+    v->period = MAX_RTC_FREQ / 2;
+    init_wait_queue(&v->wait);
+    v->next = vrtc_list;
+    if (vrtc_list)
+        vrtc_list->prev = v;
+    vrtc_list = v;
     /* rtc does not have inode */ 
     file_array[fd].inode_idx = 0;
-    /* we use file_position field to store ratio */
-    /* write virual rtc interrupt frequency */
-    file_array[fd].ratio= MAX_RTC_FREQ / 2;
+    file_array[fd].private_data = v;
+    rtc_level_users[1]++;   // 2Hz is level 1
+    rtc_stats.open++;
+    rtc_update_rate();
     return 0;      
 }
 
 /* 
  * rtc_close
  *   DESCRIPTION: close the rtc file
- *   INPUTS:    fd: file descriptor(not used)
+ *   INPUTS:    fd: file descriptor
  *   OUTPUTS: none
  *   RETURN VALUE:  0 on success
- *   SIDE EFFECTS:  none
+ *   SIDE EFFECTS:  frees the RTC's state, slows down the physical rate or
+ *                  masks IRQ 8 if this was the fastest or last open RTC
  */
 int32_t rtc_close(int32_t fd) {
-    fd = fd;
+    vrtc_t* v = file_array[fd].private_data;
+    uint32_t flags;
+
+    cli_and_save(flags);
+    timer_remove(v);
+    restore_flags(flags);
+    if (v->prev)
+        v->prev->next = v->next;
+    else
+        vrtc_list = v->next;
+    if (v->next)
+        v->next->prev = v->prev;
+    rtc_level_users[bsf(MAX_RTC_FREQ / v->period)]--;
+    rtc_stats.open--;
+    rtc_update_rate();
+    file_array[fd].private_data = NULL;
+    kfree(v);
     return 0;
 }
 
@@ -11,14 +11,72 @@
 
 #include "types.h"
 #include "process.h"
+#include "waitqueue.h"
 
 /* define the maximum and minimum frequency allowed for RTC */
 #define MAX_RTC_FREQ 512
+/* virtual frequencies are 1 << level Hz, level 0 to 9 */
+#define RTC_FREQ_LEVELS 10
+/* the slowest periodic rate the chip offers, rate 15 */
+#define MIN_RTC_PHYS_FREQ   2
+
+/* physical RTC counters, for print_rtc_stats */
+typedef struct rtc_stats {
+    /* open virtual RTCs */
+    uint32_t open;
+    /* current periodic interrupt rate in Hz, 0 while IRQ 8 is masked */
+    uint32_t phys_freq;
+    /* times the periodic rate was reprogrammed */
+    uint32_t rate_changes;
+    /* interrupts taken and TSC cycles spent in rtc_handler, ever */
+    uint32_t interrupts;
+    uint64_t handler_cycles;
+    /* the same counted over the last whole RTC second, 0 while masked */
+    uint32_t irqs_per_sec;
+    uint32_t cycles_per_sec;
+} rtc_stats_t;
+
+rtc_stats_t rtc_stats;
+
+/* one open RTC descriptor, kept in its file_abs_entry_t.private_data */
+typedef struct vrtc {
+    /* file descriptor, for print_rtc_stats */
+    int32_t fd;
+    /* rtc_counter_global units between virtual interrupts */
+    int period;
+    /* rtc_counter_global value of the next virtual interrupt, valid once
+       armed by the first read after open or write */
+    int deadline;
+    int armed;
+    /* set by rtc_handler once deadline has passed, the reader sleeps on
+       wait until then */
+    volatile int fired;
+    wait_queue_t wait;
+    /* TSC when rtc_handler found the deadline passed */
+    uint64_t fired_tsc;
+    /* timer queue link, sorted by deadline, while a reader waits */
+    struct vrtc* timer_next;
+    /* every open RTC, for print_rtc_stats */
+    struct vrtc* next;
+    struct vrtc* prev;
+    /* counters */
+    uint32_t reads;
+    /* virtual interrupts that passed while no read was waiting */
+    uint32_t missed;
+    /* TSC cycles from the deadline passing to the reader running again */
+    uint64_t jitter_cycles;
+    uint32_t max_jitter;
+} vrtc_t;
+
+/* time since boot in 1 / MAX_RTC_FREQ s units, advances only while an RTC is open */
+extern volatile int rtc_counter_global;
 
 /* initialize the rtc */
 void rtc_init();
 /* set the rtc frequency */
 void set_rtc_freq(char rate);
+/* print the physical RTC counters */
+void print_rtc_stats();
 /* handle a rtc interrupt */
 extern void rtc_handler();
 
@@ -5,41 +5,100 @@
 #include "paging.h"
 #include "process.h"
 #include "scheduling.h"
+#include "waitqueue.h"
+#include "ktime.h"
+#include "timer.h"
 
 /*  
  * start_terminal0
- *   DESCRIPTION: launch the first terminal
+ *   DESCRIPTION: launch the shells of all terminals
  *   INPUTS: none
  *   OUTPUTS: none
  *   RETURN VALUE: none
  *   SIDE EFFECTS: shell is running on the first terminal;
  *          The first terminal is being displayed;
- *          Scheduler starts from the first terminal 
+ *          the other terminals' shells wait on the run queue
  */
 void start_terminal0(){
+    int32_t term;
     active_term_idx = 0;
     terminals[0].active = 1;
+    for(term = 1; term < MAX_TERMINAL_NUM; term++)
+        spawn((uint8_t*)"shell", term);
     cur_term_id = 0;
     execute((uint8_t*)"shell");
 }
 
 /*  
- * restore_ebp
- *   DESCRIPTION: switch to another process, called by scheduler
- *   INPUTS: uint32_t ebp --- ebp of the process to switch to
+ * runqueue_add
+ *   DESCRIPTION: make a process runnable, it is appended behind the others
+ *   INPUTS: pcb_t* pcb --- process to add, ignored if already queued
  *   OUTPUTS: none
  *   RETURN VALUE: none
- *   SIDE EFFECTS: "ret" jumps to another process rather than return from restore_ebp
- *               
+ *   SIDE EFFECTS: none
+ */
+void runqueue_add(pcb_t* pcb){
+    uint32_t flags;
+    cli_and_save(flags);
+    if(pcb->run_next == NULL){
+        if(run_queue == NULL){
+            pcb->run_next = pcb;
+            pcb->run_prev = pcb;
+            run_queue = pcb;
+        }
+        else{
+            pcb->run_next = run_queue;
+            pcb->run_prev = run_queue->run_prev;
+            run_queue->run_prev->run_next = pcb;
+            run_queue->run_prev = pcb;
+        }
+    }
+    restore_flags(flags);
+}
+
+/*  
+ * runqueue_remove
+ *   DESCRIPTION: take a process off the run queue, when it blocks,
+ *              waits for a child or dies
+ *   INPUTS: pcb_t* pcb --- process to remove, ignored if not queued
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void runqueue_remove(pcb_t* pcb){
+    uint32_t flags;
+    cli_and_save(flags);
+    if(pcb->run_next != NULL){
+        if(pcb->run_next == pcb)
+            run_queue = NULL;
+        else{
+            pcb->run_prev->run_next = pcb->run_next;
+            pcb->run_next->run_prev = pcb->run_prev;
+            if(run_queue == pcb)
+                run_queue = pcb->run_next;
+        }
+        pcb->run_next = NULL;
+        pcb->run_prev = NULL;
+    }
+    restore_flags(flags);
+}
+
+/*  
+ * pick_next
+ *   DESCRIPTION: choose the process to run after prev, round-robin
+ *   INPUTS: pcb_t* prev --- process running now
+ *   OUTPUTS: none
+ *   RETURN VALUE: the process after prev on the run queue, prev itself if it
+ *                 is the only runnable one, the queue head if prev is not
+ *                 queued, NULL if nothing is runnable
+ *   SIDE EFFECTS: none
  */
-void restore_ebp(uint32_t ebp){
-    asm(
-        "movl 8(%ebp), %ebp;"
-        "leave;"
-        "ret;"
-    );
+static pcb_t* pick_next(pcb_t* prev){
+    if(prev->run_next != NULL)
+        return prev->run_next;
+    return run_queue;
 }
- 
+
 /*  
  * switch_terminal
  *   DESCRIPTION: switch to display another terminal, called when Alt + Fn are pressed
@@ -47,15 +106,15 @@ void restore_ebp(uint32_t ebp){
  *           int term_id --- index of to-be-displayed terminal
  *   OUTPUTS: none
  *   RETURN VALUE: none
- *   SIDE EFFECTS: video display is changed from the previous terminal to the new terminal             
+ *   SIDE EFFECTS: video display is changed from the previous terminal to the new terminal;
+ *                 both keep rendering into their own RAM screens, which
+ *                 vidmap pages map, so no mapping changes
  */
 void switch_terminal(int prev_id, int term_id){
-    /* Save current video mem into prev_id's page */
-    save_video_to_backup(prev_id);
-    /* Restore current video mem backup into video mem */
-    restore_backup_to_video(term_id);
     /* mark the current terminal to be displayed*/
     active_term_idx = term_id;
+    /* rewrite only the VGA rows where the two screens differ */
+    screen_switch(prev_id, term_id);
     update_cursor(terminals[active_term_idx].cursor_x, terminals[active_term_idx].cursor_y);
 
 }
@@ -63,66 +122,55 @@ void switch_terminal(int prev_id, int term_id){
 /*  
  * switch_procss
  *   DESCRIPTION: switch process routine of our scheduler
- *   INPUTS: int prev_id --- index of previous-scheduled terminal
- *           int term_id --- index of next-scheduled terminal
+ *   INPUTS: pcb_t* prev --- process running now
+ *           pcb_t* next --- process to run
  *   OUTPUTS: none
  *   RETURN VALUE: none
- *   SIDE EFFECTS: jump to the new process rather than return from switch_process
- *              "shell" may be launched for the terminal if no program is running  
+ *   SIDE EFFECTS: jump to the new process; returns only once prev is
+ *              switched back to
  */
-void switch_process(int prev_id, int term_id){
-    /* mark the term_id as the scheduled terminal index */
-    cur_term_id = term_id;
-
-    /*** SAVE EBP ***/
-    /* find lastly-scheduled process's pcb */
-    uint32_t prev_prog_num = terminals[prev_id].term_prog_counter;
-    uint32_t prev_proc_pid = terminals[prev_id].prog_pids[prev_prog_num - 1];
-    pcb_t* prev_pcb = FIND_PCB(prev_proc_pid);
-    /* store previous process pcb */
-    asm volatile(
-        "movl %%ebp, %0 \n\
-        "
-        :"=rm"(prev_pcb->term_ebp)
-        :
-        :"cc"
-    );
+void switch_process(pcb_t* prev, pcb_t* next){
+    /* mark the next process's terminal as the scheduled terminal index */
+    cur_term_id = next->term_idx;
 
     /*** SWITCH PROCESS'S VIDEO MEM ***/
     /* if the process is being displayed, video_mem is the real video memory page */
-    if(term_id == active_term_idx)
+    if(cur_term_id == active_term_idx)
         video_mem = (char*)VIDEO;
-    /* if the process is not being displayed, video_mem is the backup video memory page */
+    /* if the process is not being displayed, video_mem is its terminal's RAM screen */
     else
-        video_mem = (char*)((uint32_t)VIDEO + ((1 + term_id) << SHIFT_4K));
+        video_mem = (char*)screen_page(cur_term_id);
 
-    /*** PREPARE TO SWITCH (SET TSS, SETUP PAGING, RESTORE EBP) ***/
-    /* launch a shell if no program is running */
-    if(terminals[term_id].term_prog_counter == 0){
-        execute((uint8_t*)"shell");
-    }
-    else{
-        /* find next-scheduled process pcb */
-        uint32_t term_prog_num = terminals[term_id].term_prog_counter;
-        uint32_t new_proc_pid = terminals[term_id].prog_pids[term_prog_num - 1];
-        pcb_t* cur_pcb = FIND_PCB(new_proc_pid);
+    /* switch file array to the new process's file array*/
+    file_array = next -> file_array;
+    time_page_switch();
+    /* save prev's registers and stack, resume next with its kernel stack
+     * in the tss and its page directory in cr3 */
+    switch_to(prev, next);
+    /* back on prev's stack, so a process that halted before can go */
+    reap_zombie();
+}
 
-        // restore new process's paging scheme
-        setup_paging(new_proc_pid);
-        // restore new process's stack frame
-        tss.esp0 = PROG0_KSTACK_BOTTOM - KERNEL_STACK_SIZE * new_proc_pid;
-        tss.ss0 = KERNEL_DS;
-        /* enable video page if the process already requests*/
-        if(cur_pcb -> video_mem_flag){
-            enable_prog_vid_page();
-            change_prog_vid_mapping(term_id);
-        }
-        /* switch file array to the new process's file array*/
-        file_array = cur_pcb -> file_array;
-        /* jump to the new process */
-        if((cur_pcb -> term_ebp) != NULL)
-            restore_ebp(cur_pcb -> term_ebp);
-    }
+/*  
+ * schedule
+ *   DESCRIPTION: give up the cpu, called by sleep_on with interrupts off
+ *              after taking the current process off the run queue.
+ *              If nothing is runnable, halt on the current stack until
+ *              an interrupt makes a process runnable
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: returns only once the current process is scheduled again
+ */
+void schedule(){
+    pcb_t* prev = current;
+    pcb_t* next;
+    /* sti takes effect after hlt, so no wake up is lost in between */
+    while((next = pick_next(prev)) == NULL)
+        asm volatile ("sti; hlt; cli" : : : "memory");
+    if(next == prev)
+        return;
+    switch_process(prev, next);
 }
 
 /*  
@@ -131,35 +179,40 @@ void switch_process(int prev_id, int term_id){
  *   INPUTS: none
  *   OUTPUTS: none
  *   RETURN VALUE: none
- *   SIDE EFFECTS: all 3 terminals' backup video memory pages are also initialized
+ *   SIDE EFFECTS: all 3 terminals' RAM screens are also initialized
  */
 void init_terminals(){
     int i;
     int j;
-    int term;
+    uint8_t* screen;
     for(i = 0; i < MAX_TERMINAL_NUM; i++){
         terminals[i].active = 0;
         terminals[i].buf_index = 0;
         terminals[i].cursor_x = 0;
         terminals[i].cursor_y = 0;
-        terminals[i].TERMINAL_READ_FLAG = 0;
         memset(terminals[i].keyboard_buf, 0, KB_BUF_SIZE);
-        memset(terminals[i].prog_pids, 0, MAX_PROG_NUM_PER_TERM);
-        /* initialize 3 backup video page for 3 terminals */
-        for(term = 1; term <= TERM_NUM; term++){
-            for (j = 0; j < NUM_ROWS * NUM_COLS; j++) {
-                if (j % NUM_COLS == 0)
-                    *(uint8_t *)((VIDEO + (term << SHIFT_4K)) + (j << 1)) = ' ';
-                else
-                    *(uint8_t *)((VIDEO + (term << SHIFT_4K)) + (j << 1)) = 0;
-                *(uint8_t *)((VIDEO + (term << SHIFT_4K)) + (j << 1) + 1) = ATTRIB;
-            }
+        terminals[i].kb_head = 0;
+        terminals[i].kb_tail = 0;
+        terminals[i].kb_overruns = 0;
+        terminals[i].top_pid = -1;
+        init_wait_queue(&terminals[i].read_wait);
+        /* initialize the terminal's RAM screen */
+        screen = screen_page(i);
+        terminals[i].top_row = 0;
+        terminals[i].vidmap_users = 0;
+        for (j = 0; j < NUM_ROWS * NUM_COLS; j++) {
+            if (j % NUM_COLS == 0)
+                screen[j << 1] = ' ';
+            else
+                screen[j << 1] = 0;
+            screen[(j << 1) + 1] = ATTRIB;
         }
         /* set running program number of current terminal to 0 */
         terminals[i].term_prog_counter = 0;
     }
     /* schedule terminal 0 at first */
     cur_term_id = 0;
+    run_queue = NULL;
 }
 
 /*  
@@ -179,23 +232,37 @@ void pit_init() {
 /*  
  * pit_handler
  *   DESCRIPTION: pit interrupt handler, called when pit interrupts.
- *              call switch_process to achieve scheduling
+ *              call switch_process to achieve scheduling. Only processes
+ *              on the run queue are picked. Also pushes the displayed
+ *              screen to VGA if a vidmap page may have changed it,
+ *              counts the tick in the time page and runs due timers
  *   INPUTS:  none
  *   OUTPUTS: none
  *   RETURN VALUE: none
  *   SIDE EFFECTS: none
  */
 void pit_handler() {
+    pcb_t* prev;
+    pcb_t* next;
+    /* publish the tick for user clock reads */
+    time_page_tick();
+    /* run the timers due, they may wake sleepers */
+    timer_tick();
     if (!prog_counter) {
         send_eoi(0);
         return;
     }
-    /* round-robin scheduling */
-    prev_term_id = cur_term_id;
-    cur_term_id = (cur_term_id + 1) % MAX_TERMINAL_NUM;
+    /* show what vidmap programs drew on the displayed screen */
+    screen_sync();
+    /* round-robin over the run queue */
+    prev = current;
+    next = pick_next(prev);
 
     send_eoi(0);
+    /* keep running (or idling) if nothing else is runnable */
+    if (next == NULL || next == prev)
+        return;
     /* switch to the new process */
-    switch_process(prev_term_id, cur_term_id);
+    switch_process(prev, next);
     return;
 }
@@ -1,6 +1,8 @@
 #ifndef _SCHEDULE_H
 #define _SCHEDULE_H
 
+#include "process.h"
+
 //#define cur_term_id active_term_idx
 
 #define PIT_FREQ_SET    0x36
@@ -20,7 +22,13 @@ void switch_terminal(int prev_id, int term_id);
 /* initialize 3 terminals */
 void init_terminals();
 /* scheduler switch process */
-void switch_process();
+void switch_process(pcb_t* prev, pcb_t* next);
+/* give up the cpu to the next runnable process */
+void schedule();
+/* make a process runnable */
+void runqueue_add(pcb_t* pcb);
+/* take a process off the run queue */
+void runqueue_remove(pcb_t* pcb);
 /* initialize pit */
 void pit_init();
 /* pit interrupt handler */
@@ -30,6 +38,8 @@ extern void pit_handler();
 int32_t cur_term_id;
 /* the index of the terminal which is lastly scheduled */
 int32_t prev_term_id;
+/* circular list of runnable processes, through pcb->run_next */
+pcb_t* run_queue;
 /* note: active_term_idx defined in keyboard.h is the terminal
  * which is being displayed. They are NOT the same index.
  */
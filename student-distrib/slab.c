@@ -0,0 +1,375 @@
+#include "lib.h"
+#include "types.h"
+#include "slab.h"
+#include "page_alloc.h"
+
+#define PAGE_SIZE_BYTES 4096
+#define FRAME_SHIFT     12
+/* fewest objects in a kmalloc slab */
+#define KMALLOC_MIN_OBJS 8
+
+static slab_t slab_descs[SLAB_DESC_NUM];
+static slab_t* free_descs = NULL;
+static uint32_t descs_ready = 0;
+
+/* per pool frame: index + 1 of the slab descriptor owning it, 0 if none */
+static uint16_t frame_slab[PAGE_POOL_FRAMES];
+
+/* every initialized cache */
+static kmem_cache_t* caches = NULL;
+
+static kmem_cache_t kmalloc_caches[KMALLOC_CLASSES];
+static const char* kmalloc_names[KMALLOC_CLASSES] = {
+    "kmalloc-16", "kmalloc-32", "kmalloc-64", "kmalloc-128",
+    "kmalloc-256", "kmalloc-512", "kmalloc-1024", "kmalloc-2048"
+};
+
+/*
+ * slab_desc_alloc
+ *   DESCRIPTION: take an unused slab descriptor
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: descriptor, NULL if all are in use
+ *   SIDE EFFECTS: builds the descriptor free list on first use
+ */
+static slab_t* slab_desc_alloc() {
+    slab_t* desc;
+    uint32_t i;
+    if (!descs_ready) {
+        for (i = 0; i < SLAB_DESC_NUM; i++) {
+            slab_descs[i].next = free_descs;
+            free_descs = &slab_descs[i];
+        }
+        descs_ready = 1;
+    }
+    desc = free_descs;
+    if (desc != NULL)
+        free_descs = desc->next;
+    return desc;
+}
+
+/*
+ * slab_of
+ *   DESCRIPTION: find the slab an object lives in through the frame map
+ *   INPUTS: obj -- object address
+ *   OUTPUTS: none
+ *   RETURN VALUE: owning slab, NULL if obj is not in any slab
+ *   SIDE EFFECTS: none
+ */
+static slab_t* slab_of(void* obj) {
+    uint32_t addr = (uint32_t)obj;
+    uint32_t idx;
+    if (addr < PAGE_POOL_START || addr >= PAGE_POOL_END)
+        return NULL;
+    idx = frame_slab[(addr - PAGE_POOL_START) >> FRAME_SHIFT];
+    return idx ? &slab_descs[idx - 1] : NULL;
+}
+
+/*
+ * slab_set_frames
+ *   DESCRIPTION: point every frame of a slab at its descriptor
+ *   INPUTS: slab -- slab whose base is set
+ *           order -- slab order
+ *           idx -- descriptor index + 1, or 0 to clear
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void slab_set_frames(slab_t* slab, uint32_t order, uint16_t idx) {
+    uint32_t frame = (slab->base - PAGE_POOL_START) >> FRAME_SHIFT;
+    uint32_t i;
+    for (i = 0; i < (1U << order); i++)
+        frame_slab[frame + i] = idx;
+}
+
+/*
+ * partial_push
+ *   DESCRIPTION: put a slab at the head of its cache's partial list
+ *   INPUTS: cache -- owning cache
+ *           slab -- slab with a free object, not on the list
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void partial_push(kmem_cache_t* cache, slab_t* slab) {
+    slab->prev = NULL;
+    slab->next = cache->partial;
+    if (slab->next != NULL)
+        slab->next->prev = slab;
+    cache->partial = slab;
+}
+
+/*
+ * partial_unlink
+ *   DESCRIPTION: take a slab off its cache's partial list
+ *   INPUTS: cache -- owning cache
+ *           slab -- slab on the list
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void partial_unlink(kmem_cache_t* cache, slab_t* slab) {
+    if (slab->prev != NULL)
+        slab->prev->next = slab->next;
+    else
+        cache->partial = slab->next;
+    if (slab->next != NULL)
+        slab->next->prev = slab->prev;
+    slab->next = NULL;
+    slab->prev = NULL;
+}
+
+/*
+ * slab_grow
+ *   DESCRIPTION: add an empty slab from the page allocator to a cache
+ *   INPUTS: cache -- cache to grow
+ *   OUTPUTS: none
+ *   RETURN VALUE: the new slab, on the partial list; NULL if out of memory
+ *                 or descriptors
+ *   SIDE EFFECTS: none
+ */
+static slab_t* slab_grow(kmem_cache_t* cache) {
+    slab_t* slab;
+    uint32_t w, left;
+
+    if ((slab = slab_desc_alloc()) == NULL)
+        return NULL;
+    if ((slab->base = page_alloc(cache->order)) == 0) {
+        slab->next = free_descs;
+        free_descs = slab;
+        return NULL;
+    }
+    slab->summary = 0;
+    for (w = 0, left = cache->objs_per_slab; w < SLAB_MAP_WORDS; w++) {
+        if (left >= 32) {
+            slab->free_map[w] = 0xFFFFFFFF;
+            left -= 32;
+        } else {
+            slab->free_map[w] = (1 << left) - 1;
+            left = 0;
+        }
+        if (slab->free_map[w])
+            slab->summary |= 1 << w;
+    }
+    slab->in_use = 0;
+    slab->cache = cache;
+    slab_set_frames(slab, cache->order, (uint16_t)(slab - slab_descs + 1));
+    partial_push(cache, slab);
+    cache->slab_count++;
+    return slab;
+}
+
+/*
+ * slab_release
+ *   DESCRIPTION: give an empty slab's pages and descriptor back
+ *   INPUTS: cache -- owning cache
+ *           slab -- empty slab on the partial list
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void slab_release(kmem_cache_t* cache, slab_t* slab) {
+    partial_unlink(cache, slab);
+    slab_set_frames(slab, cache->order, 0);
+    page_free(slab->base, cache->order);
+    slab->cache = NULL;
+    slab->next = free_descs;
+    free_descs = slab;
+    cache->slab_count--;
+}
+
+/*
+ * kmem_cache_init
+ *   DESCRIPTION: set up an empty cache of fixed-size objects
+ *   INPUTS: cache -- cache to set up
+ *           name -- shown by print_cache_stats
+ *           size -- object size in bytes
+ *           align -- object alignment, a power of two no larger than a slab
+ *           order -- each slab is 1 << order pages
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: adds the cache to the list print_slab_stats walks
+ */
+void kmem_cache_init(kmem_cache_t* cache, const char* name, uint32_t size, uint32_t align, uint32_t order) {
+    kmem_cache_t* c;
+
+    cache->name = name;
+    cache->obj_size = (size + align - 1) & ~(align - 1);
+    cache->order = order;
+    cache->objs_per_slab = (PAGE_SIZE_BYTES << order) / cache->obj_size;
+    if (cache->objs_per_slab > SLAB_MAX_OBJS)
+        cache->objs_per_slab = SLAB_MAX_OBJS;
+    cache->partial = NULL;
+    cache->empty = NULL;
+    cache->allocs = 0;
+    cache->frees = 0;
+    cache->hits = 0;
+    cache->failures = 0;
+    cache->slab_count = 0;
+    cache->in_use = 0;
+    cache->peak_in_use = 0;
+
+    for (c = caches; c != NULL && c != cache; c = c->next_cache);
+    if (c == NULL) {
+        cache->next_cache = caches;
+        caches = cache;
+    }
+}
+
+/*
+ * kmem_cache_alloc
+ *   DESCRIPTION: allocate one object from the slab at the head of the
+ *                partial list, adding a slab from the page allocator only
+ *                if no slab has room; two bsf find the free object
+ *   INPUTS: cache -- cache to allocate from
+ *   OUTPUTS: none
+ *   RETURN VALUE: object (not cleared), NULL if out of memory
+ *   SIDE EFFECTS: none
+ */
+void* kmem_cache_alloc(kmem_cache_t* cache) {
+    slab_t* slab = cache->partial;
+    uint32_t word, bit;
+
+    if (slab != NULL) {
+        cache->hits++;
+    } else if ((slab = slab_grow(cache)) == NULL) {
+        cache->failures++;
+        return NULL;
+    }
+    if (slab == cache->empty)
+        cache->empty = NULL;
+
+    word = bsf(slab->summary);
+    bit = bsf(slab->free_map[word]);
+    slab->free_map[word] &= ~(1 << bit);
+    if (!slab->free_map[word])
+        slab->summary &= ~(1 << word);
+    if (++slab->in_use == cache->objs_per_slab)
+        partial_unlink(cache, slab);
+
+    cache->allocs++;
+    if (++cache->in_use > cache->peak_in_use)
+        cache->peak_in_use = cache->in_use;
+    return (void*)(slab->base + (word * 32 + bit) * cache->obj_size);
+}
+
+/*
+ * kmem_cache_free
+ *   DESCRIPTION: free one object. The slab it empties is kept so the
+ *                object's memory is not handed out as anything else right
+ *                away (halt frees the pcb whose kernel stack it is still
+ *                running on); the empty slab kept before it goes back to
+ *                the page allocator
+ *   INPUTS: cache -- cache the object came from
+ *           obj -- object from kmem_cache_alloc
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void kmem_cache_free(kmem_cache_t* cache, void* obj) {
+    slab_t* slab = slab_of(obj);
+    uint32_t idx;
+
+    if (slab == NULL || slab->cache != cache)
+        return;
+    idx = ((uint32_t)obj - slab->base) / cache->obj_size;
+    /* already free */
+    if (slab->free_map[idx / 32] & (1 << (idx % 32)))
+        return;
+    slab->free_map[idx / 32] |= 1 << (idx % 32);
+    slab->summary |= 1 << (idx / 32);
+    if (slab->in_use-- == cache->objs_per_slab)
+        partial_push(cache, slab);
+    cache->frees++;
+    cache->in_use--;
+
+    if (slab->in_use == 0) {
+        if (cache->empty != NULL && cache->empty != slab)
+            slab_release(cache, cache->empty);
+        cache->empty = slab;
+    }
+}
+
+/*
+ * print_cache_stats
+ *   DESCRIPTION: print a cache's counters
+ *   INPUTS: cache -- cache to report
+ *   OUTPUTS: one line to the screen
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void print_cache_stats(kmem_cache_t* cache) {
+    uint32_t hit_pct = cache->allocs ? (uint32_t)div_u64_u32((uint64_t)cache->hits * 100, cache->allocs, NULL) : 0;
+    printf("%s: %d/%d in use (peak %d), %d slabs of %d, %d allocs %d%% hit, %d fails\n",
+           cache->name, cache->in_use, cache->slab_count * cache->objs_per_slab,
+           cache->peak_in_use, cache->slab_count, cache->objs_per_slab,
+           cache->allocs, hit_pct, cache->failures);
+}
+
+/*
+ * kmalloc_init
+ *   DESCRIPTION: set up the power-of-two size-class caches, with slabs
+ *                big enough for KMALLOC_MIN_OBJS objects so large classes
+ *                do not use up the slab descriptors
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void kmalloc_init() {
+    uint32_t i, size, order;
+    for (i = 0; i < KMALLOC_CLASSES; i++) {
+        size = 1 << (KMALLOC_MIN_SHIFT + i);
+        for (order = 0; (PAGE_SIZE_BYTES << order) < size * KMALLOC_MIN_OBJS; order++);
+        kmem_cache_init(&kmalloc_caches[i], kmalloc_names[i], size, size, order);
+    }
+}
+
+/*
+ * kmalloc
+ *   DESCRIPTION: allocate from the smallest size class that fits, aligned
+ *                to the class size
+ *   INPUTS: size -- bytes wanted, 1 to KMALLOC_MAX
+ *   OUTPUTS: none
+ *   RETURN VALUE: memory (not cleared), NULL if size is out of range or
+ *                 memory ran out
+ *   SIDE EFFECTS: none
+ */
+void* kmalloc(uint32_t size) {
+    uint32_t i = 0;
+    if (size == 0 || size > KMALLOC_MAX)
+        return NULL;
+    while ((1U << (KMALLOC_MIN_SHIFT + i)) < size)
+        i++;
+    return kmem_cache_alloc(&kmalloc_caches[i]);
+}
+
+/*
+ * kfree
+ *   DESCRIPTION: free an object, finding its cache through the frame map
+ *   INPUTS: obj -- memory from kmalloc or kmem_cache_alloc, or NULL
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void kfree(void* obj) {
+    slab_t* slab = slab_of(obj);
+    if (slab != NULL)
+        kmem_cache_free(slab->cache, obj);
+}
+
+/*
+ * print_slab_stats
+ *   DESCRIPTION: print the counters of every cache that has been used
+ *   INPUTS: none
+ *   OUTPUTS: one line per cache to the screen
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void print_slab_stats() {
+    kmem_cache_t* cache;
+    for (cache = caches; cache != NULL; cache = cache->next_cache) {
+        if (cache->allocs)
+            print_cache_stats(cache);
+    }
+}
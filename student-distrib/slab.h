@@ -0,0 +1,78 @@
+#ifndef _SLAB_H
+#define _SLAB_H
+
+#include "types.h"
+
+/* objects per slab are tracked in a two-level free map of 32-bit words */
+#define SLAB_MAP_WORDS  8
+#define SLAB_MAX_OBJS   (SLAB_MAP_WORDS * 32)
+/* slab descriptors kept off-slab, so objects can fill whole pages */
+#define SLAB_DESC_NUM   1024
+
+/* kmalloc size classes: 16, 32, ... KMALLOC_MAX bytes. A slab holds at least
+ * 8 objects: one page for 16 to 512 bytes, order 1 for 1024, order 2 for 2048 */
+#define KMALLOC_MIN_SHIFT   4
+#define KMALLOC_MAX_SHIFT   11
+#define KMALLOC_MAX         (1 << KMALLOC_MAX_SHIFT)
+#define KMALLOC_CLASSES     (KMALLOC_MAX_SHIFT - KMALLOC_MIN_SHIFT + 1)
+
+/* one block of pages carved into equal objects */
+typedef struct slab {
+    /* address of the first object */
+    uint32_t base;
+    /* bit w set: free_map[w] has a free object */
+    uint32_t summary;
+    /* bit i of word w set: object w * 32 + i is free */
+    uint32_t free_map[SLAB_MAP_WORDS];
+    uint32_t in_use;
+    /* cache the slab belongs to, for kfree */
+    struct kmem_cache* cache;
+    /* partial list links, NULL while the slab is full */
+    struct slab* next;
+    struct slab* prev;
+} slab_t;
+
+/* a pool of same-sized objects */
+typedef struct kmem_cache {
+    const char* name;
+    /* object size, a multiple of the alignment */
+    uint32_t obj_size;
+    /* each slab is 1 << order pages */
+    uint32_t order;
+    uint32_t objs_per_slab;
+    /* slabs with at least one free object, allocations come from the head */
+    slab_t* partial;
+    /* the one empty slab kept for reuse, NULL if none */
+    slab_t* empty;
+    /* every cache, for print_slab_stats */
+    struct kmem_cache* next_cache;
+    /* counters */
+    uint32_t allocs;
+    uint32_t frees;
+    /* allocations served without taking pages from the page allocator */
+    uint32_t hits;
+    uint32_t failures;
+    uint32_t slab_count;
+    uint32_t in_use;
+    uint32_t peak_in_use;
+} kmem_cache_t;
+
+/* set up an empty cache */
+void kmem_cache_init(kmem_cache_t* cache, const char* name, uint32_t size, uint32_t align, uint32_t order);
+/* allocate one object, growing the cache by a slab if needed */
+void* kmem_cache_alloc(kmem_cache_t* cache);
+/* free one object, releasing its slab once it is empty */
+void kmem_cache_free(kmem_cache_t* cache, void* obj);
+/* print a cache's counters */
+void print_cache_stats(kmem_cache_t* cache);
+
+/* set up the kmalloc size-class caches */
+void kmalloc_init();
+/* allocate size bytes (at most KMALLOC_MAX) from the smallest class that fits */
+void* kmalloc(uint32_t size);
+/* free memory from kmalloc or any kmem_cache_alloc */
+void kfree(void* obj);
+/* print the counters of every cache */
+void print_slab_stats();
+
+#endif
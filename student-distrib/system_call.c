@@ -1,24 +1,27 @@
 #include "lib.h"
 #include "system_call.h"
+#include "system_call_linkage.h"
 #include "process.h"
 #include "file_system.h"
 #include "rtc.h"
 #include "keyboard.h"
 #include "paging.h"
 #include "scheduling.h"
+#include "image_cache.h"
+#include "page_alloc.h"
 
-#define PROGRAM_PAGE_VIRTUAL_ADDR  0x08000000
 #define OFFSET   0x400000
-#define MAX_PROGRAM_COUNT   6
 
 #define PROG_COUNTER_OFFSET 2
-#define EIP_OFFSET          24
 #define NAME_LENGTH         32
 #define PARAM_LENGTH        128
 
 #define PROG_LIMIT_REACHED  1
 #define EXP_ERROR           256
 
+/* IF set, plus the always-one bit 1 */
+#define EFLAGS_USER         0x202
+
 #define MB_128 0x08000000
 #define MB_132 0x08400000
 
@@ -28,17 +31,17 @@
  *   INPUTS: status -- return value to parent program
  *   OUTPUTS: none
  *   RETURN VALUE: none
- *   SIDE EFFECTS: none
+ *   SIDE EFFECTS: a root shell is started again on its terminal; if that
+ *                 fails the terminal is left idle
  */
 int32_t halt(uint8_t status) {
     /* critical section begins */
     pcb_t* parent_pcb_ptr;
     pcb_t* child_pcb_ptr;
+    int32_t child_ebp;
 
     /* get parent and child pcb */
-    uint32_t term_prog_num = terminals[cur_term_id].term_prog_counter;
-    uint32_t child_pcb_pid = terminals[cur_term_id].prog_pids[term_prog_num - 1];
-    child_pcb_ptr = FIND_PCB(child_pcb_pid);
+    child_pcb_ptr = current;
     parent_pcb_ptr = child_pcb_ptr -> parent_pcb_pointer;
     /* set current process to dead */
     child_pcb_ptr->status = 0;
@@ -51,33 +54,59 @@ int32_t halt(uint8_t status) {
             close(fd);
     }
 
+    /* unpin the program image, it stays cached for the next launch */
+    image_cache_put(child_pcb_ptr->exec_image);
+    child_pcb_ptr->exec_image = NULL;
+
+    /* the parent resumes in execute, the child never runs again */
+    runqueue_remove(child_pcb_ptr);
+    if(parent_pcb_ptr != NULL)
+        runqueue_add(parent_pcb_ptr);
+
     /* re-launch the shell if halt the shell */
     if(parent_pcb_ptr == NULL){
         prog_counter--;
         terminals[cur_term_id].term_prog_counter = 0;
+        terminals[cur_term_id].top_pid = -1;
+        /* no scheduling until the new shell runs on its own kernel stack */
+        cli();
+        /* leave the child's page directory before it is freed */
+        load_page_directory(page_directory);
+        /* the new shell gets a fresh pcb, ours is kept until we are off its stack */
+        exit_pcb(child_pcb_ptr);
         clear();
         _execute((uint8_t *)"shell");
+        /* no pid, memory or shell image: leave the terminal idle with no
+         * program, and give up the cpu for good. Off the run queue we are
+         * never picked again, so the zombie is reaped behind us */
+        printf("FAIL: cannot restart the shell, terminal %d is idle\n", cur_term_id);
+        file_array = NULL;
+        for (;;)
+            schedule();
     }
-    /* disable the video memory page that the program was using */
-    disable_prog_vid_page();
-    child_pcb_ptr->video_mem_flag = 0;
-
     /* switch to parent's file array */
     file_array = parent_pcb_ptr->file_array;
     prog_counter--;
     terminals[cur_term_id].term_prog_counter--;
+    terminals[cur_term_id].top_pid = parent_pcb_ptr->pid;
 
-    /* switch to parent process program page */
-    setup_paging(parent_pcb_ptr -> pid);
+    /* switch to parent process address space, dropping the child's vidmap too */
+    load_page_directory(parent_pcb_ptr->page_dir);
+
+    /* release the child; no scheduling until we are off its kernel stack,
+     * which the parent frees once execute returns into it */
+    child_ebp = child_pcb_ptr->ebp;
+    cli();
+    exit_pcb(child_pcb_ptr);
 
     // handle program terminates by exception
     if(program_exception_flag) {
         program_exception_flag = 0;
-        jump_to_exec_ret(child_pcb_ptr->ebp, EXP_ERROR);
+        jump_to_exec_ret(child_ebp, EXP_ERROR, parent_pcb_ptr);
     }
     /* jump to execute's return */
     else
-        jump_to_exec_ret(child_pcb_ptr->ebp, (uint32_t)status);
+        jump_to_exec_ret(child_ebp, (uint32_t)status, parent_pcb_ptr);
 
     // never reach here
     return 0;
@@ -88,14 +117,13 @@ int32_t halt(uint8_t status) {
  *   DESCRIPTION: Jump to return of execute system call
  *   INPUTS: ebp -- ebp of the current program execution
  *        status -- return value of the current program
+ *        parent -- the process execute returns into
  *   OUTPUTS: none
  *   RETURN VALUE: 0 (not used)
  *   SIDE EFFECTS: jump to execution return
  */
-int32_t jump_to_exec_ret(int32_t ebp, uint32_t status) {
-    uint32_t term_prog_num = terminals[cur_term_id].term_prog_counter;
-    uint32_t new_proc_pid = terminals[cur_term_id].prog_pids[term_prog_num - 1];
-    tss.esp0 = PROG0_KSTACK_BOTTOM - KERNEL_STACK_SIZE * new_proc_pid;
+int32_t jump_to_exec_ret(int32_t ebp, uint32_t status, pcb_t* parent) {
+    tss.esp0 = KSTACK_TOP(parent);
     tss.ss0 = KERNEL_DS;
     // 12: 2nd argument, 8: 1st argument
     asm(
@@ -120,31 +148,66 @@ int32_t jump_to_exec_ret(int32_t ebp, uint32_t status) {
  */
 int32_t execute(const uint8_t* command){
     int32_t ret_val = _execute(command);
+    /* back on our own stack: the child that halted can go */
+    reap_zombie();
     return ret_val;
 }
 
-/* Helper function to execute, functionality described in execute's function header */
-int32_t _execute(const uint8_t* command) {
+/*  
+ * exec_abort
+ *   DESCRIPTION: undo exec_load after create_pcb succeeded but the program
+ *                could not be loaded
+ *   INPUTS: pcb -- the new process, never run
+ *           term -- terminal it was created on
+ *           prev_files -- file array in use before create_pcb
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: back in the parent's page directory, or the kernel's for
+ *                 a root program
+ */
+static void exec_abort(pcb_t* pcb, int32_t term, file_abs_entry_t* prev_files) {
+    pcb_t* parent = pcb->parent_pcb_pointer;
+
+    /* leave the new directory before it is freed */
+    load_page_directory(parent != NULL ? parent->page_dir : page_directory);
+    image_cache_put(pcb->exec_image);
+    pcb->exec_image = NULL;
+
+    file_array = prev_files;
+    prog_counter--;
+    terminals[term].term_prog_counter--;
+    terminals[term].top_pid = (parent != NULL) ? parent->pid : -1;
+    free_pcb(pcb);
+}
+
+/*  
+ * exec_load
+ *   DESCRIPTION: parse command, create a pcb for it on a terminal and load
+ *                the program into that pcb's address space
+ *   INPUTS: command -- space-separated sequence of words: [filename] [other arguments]
+ *           term -- terminal the program runs on
+ *           pcb_out -- the new process on success
+ *           entry -- the program's first instruction on success
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success
+ *                 -1 if the command cannot be executed
+ *                 PROG_LIMIT_REACHED if there is no memory for a new task
+ *   SIDE EFFECTS: the new process's program table is mapped at 128MB on
+ *                 success; nothing is left behind on failure
+ */
+static int32_t exec_load(const uint8_t* command, int32_t term, pcb_t** pcb_out, uint32_t* entry) {
     /* check command validity */
     if (!command)
         return -1;
 
+    uint64_t exec_start = rdtsc();
     uint8_t filename[NAME_LENGTH + 1];
     uint8_t params[PARAM_LENGTH];
     dentry_t exec_dentry;
+    program_info_t exec_info;
     int32_t pid;
     pcb_t* cur_pcb;
-
-    /* check if exceed max program number limit */
-    if (terminals[cur_term_id].term_prog_counter >= MAX_PROG_NUM_PER_TERM) {
-        printf("FAIL: cannot execute more than 4 tasks in a terminal!\n");
-        return PROG_LIMIT_REACHED;
-    }
-    
-    if(prog_counter >= MAX_PROGRAM_COUNT) {
-        printf("FAIL: cannot execute more than 6 tasks!\n");
-        return PROG_LIMIT_REACHED;
-    }
+    file_abs_entry_t* prev_files = file_array;
 
     /* parse command */
     parse_command(command, filename, params);
@@ -153,29 +216,53 @@ int32_t _execute(const uint8_t* command) {
     if (read_dentry_by_name(filename, &exec_dentry) == -1)
         return -1;
 
-    /* check validity */
-    if (check_validity(&exec_dentry) == -1) 
+    /* check validity, and get program's eip value and segments */
+    if (check_validity(&exec_dentry, &exec_info) == -1) 
         return -1;
 
     /* create pcb */
-    pid = create_pcb();
-    /* cannot allocate a pcb for a new task */
+    pid = create_pcb(term);
+    /* cannot allocate a pcb for a new task: out of pids or memory */
     if (pid == -1){
-        return -1;
+        printf("FAIL: no memory for a new task!\n");
+        return PROG_LIMIT_REACHED;
     }  
     cur_pcb = FIND_PCB(pid);
+    cur_pcb->exec_start_tsc = exec_start;
 
-    /* setup paging */
-    setup_paging(pid);
+    /* switch to the new address space, so the loader can fill it */
+    load_page_directory(cur_pcb->page_dir);
 
-    /* load the program */
-    program_loader(&exec_dentry);
+    /* load the program; eager loading fails on no memory or a short read */
+    if (program_loader(&exec_info, cur_pcb) == -1) {
+        exec_abort(cur_pcb, term, prev_files);
+        return -1;
+    }
 
     /* store the program's argument, the maximum # of chars for parameters is 128 */
     memcpy(cur_pcb->params, params, 128);
 
-    /* get program's eip value */
-    int32_t eip = *(int32_t*)(PROGRAM_DIRECTORY_VIRTUAL_ADDR + EIP_OFFSET);
+    /* eager loading: the image is in place before the first instruction */
+    if (!demand_paging)
+        exec_timing_stop(cur_pcb);
+
+    *pcb_out = cur_pcb;
+    *entry = exec_info.entry;
+    return 0;
+}
+
+/* Helper function to execute, functionality described in execute's function header */
+int32_t _execute(const uint8_t* command) {
+    pcb_t* cur_pcb;
+    uint32_t entry;
+    int32_t ret_val = exec_load(command, cur_term_id, &cur_pcb, &entry);
+    if (ret_val)
+        return ret_val;
+
+    /* the parent waits for the child: only the child is runnable */
+    if (cur_pcb->parent_pcb_pointer != NULL)
+        runqueue_remove(cur_pcb->parent_pcb_pointer);
+    runqueue_add(cur_pcb);
 
     /* store ebp for context switch from halt */
     asm volatile(
@@ -185,11 +272,85 @@ int32_t _execute(const uint8_t* command) {
 
     /* context_switch */
     /* beginning esp -4 to prevent page fault when dereferencing at 0x84000000 */
-    context_switch(eip, USER_CS, PROGRAM_PAGE_VIRTUAL_ADDR + OFFSET - 4, USER_DS);
+    context_switch(entry, USER_CS, PROGRAM_PAGE_VIRTUAL_ADDR + OFFSET - 4, USER_DS, cur_pcb);
     // will never reach
     return 0;
 }
 
+/*  
+ * spawn
+ *   DESCRIPTION: start a root program on a terminal without running it. Its
+ *                kernel stack holds an iret frame, and its saved context
+ *                resumes at ret_to_user, so the scheduler's first switch_to
+ *                enters the program's first instruction
+ *   INPUTS: command -- space-separated sequence of words: [filename] [other arguments]
+ *           term -- terminal with no program running
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 if the program cannot be started
+ *   SIDE EFFECTS: the new process is on the run queue
+ */
+int32_t spawn(const uint8_t* command, int32_t term) {
+    pcb_t* pcb;
+    uint32_t entry;
+    uint32_t* sp;
+    if (exec_load(command, term, &pcb, &entry))
+        return -1;
+
+    /* iret frame for ret_to_user */
+    sp = (uint32_t*)KSTACK_TOP(pcb);
+    *--sp = USER_DS;
+    *--sp = PROGRAM_PAGE_VIRTUAL_ADDR + OFFSET - 4;
+    *--sp = EFLAGS_USER;
+    *--sp = USER_CS;
+    *--sp = entry;
+    /* switch_to resumes it with esp at the iret frame */
+    pcb->thread.esp = (uint32_t)sp;
+    pcb->thread.eip = (uint32_t)ret_to_user;
+
+    runqueue_add(pcb);
+    return 0;
+}
+
+/*  
+ * exec_timing_stop
+ *   DESCRIPTION: account the cycles from execute to the program's first
+ *                instruction, under the current loading mode
+ *   INPUTS: pcb -- the process that just reached user space
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: updates exec_stats, clears pcb's start stamp
+ */
+void exec_timing_stop(pcb_t* pcb) {
+    exec_stats_t* stats = &exec_stats[demand_paging ? 1 : 0];
+    uint32_t cycles;
+    if (!pcb->exec_start_tsc)
+        return;
+
+    cycles = (uint32_t)(rdtsc() - pcb->exec_start_tsc);
+    pcb->exec_start_tsc = 0;
+    stats->count++;
+    stats->last_cycles = cycles;
+    stats->total_cycles += cycles;
+}
+
+/*  
+ * print_exec_stats
+ *   DESCRIPTION: print exec-to-first-instruction latency for both loading modes
+ *   INPUTS: none
+ *   OUTPUTS: one line per mode
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void print_exec_stats() {
+    int32_t i;
+    for (i = 0; i < 2; i++) {
+        exec_stats_t* stats = &exec_stats[i];
+        uint32_t avg = stats->count ? (uint32_t)div_u64_u32(stats->total_cycles, stats->count, 0) : 0;
+        printf("%s: %d execs, last %d cycles, avg %d cycles\n",
+               i ? "demand" : "eager ", stats->count, stats->last_cycles, avg);
+    }
+}
+
 /*  
  * read
  *   DESCRIPTION: syscall that read data from the keyboard, a file, device (RTC), or directory
@@ -283,7 +444,10 @@ int32_t open(const uint8_t* filename) {
     }
 
     /* invoke file specific system call */
-    ((file_array[fd].op_ptr)->open)(fd);
+    if (((file_array[fd].op_ptr)->open)(fd) == -1) {
+        file_array[fd].flags = 0;
+        return -1;
+    }
 
     return fd;
 }
@@ -321,9 +485,7 @@ int32_t close(int32_t fd) {
  */
 int32_t getargs(uint8_t* buf, int32_t nbytes) {
     /* find current process's pcb */
-    uint32_t term_prog_num = terminals[cur_term_id].term_prog_counter;
-    uint32_t cur_pid = terminals[cur_term_id].prog_pids[term_prog_num - 1];
-    pcb_t* cur_pcb = FIND_PCB(cur_pid);
+    pcb_t* cur_pcb = current;
 
     /* check validity */
     if (nbytes < strlen((int8_t*)cur_pcb->params) + 1 || *cur_pcb->params == '\0')
@@ -341,24 +503,28 @@ int32_t getargs(uint8_t* buf, int32_t nbytes) {
  *   OUTPUTS: none
  *   RETURN VALUE: 0 if successful
  *                 -1 if the location is invalid (not in user-space)
- *   SIDE EFFECTS: none
+ *                 or there is no memory for the video page table
+ *   SIDE EFFECTS: the mapping lives in the process's own page directory;
+ *                 the terminal's RAM screen stays linear while it is mapped
  */
 int32_t vidmap(uint8_t** screen_start) {
     /* check for range */
     if ((uint32_t) screen_start < MB_128 || (uint32_t) screen_start >= MB_132)
         return -1;
     
-    /* enable user-access video memory */
-    enable_prog_vid_page();
+    /* map user-access video memory into the process's own directory */
+    pcb_t* cur_pcb = current;
+    if (cur_pcb->vid_table == NULL) {
+        if ((cur_pcb->vid_table = (page_table_entry_t*)page_alloc(0)) == NULL)
+            return -1;
+        map_prog_vid_page(cur_pcb->page_dir, cur_pcb->vid_table, cur_pcb->term_idx);
+        /* the page shows the screen linearly from now on */
+        terminals[cur_pcb->term_idx].vidmap_users++;
+        screen_normalize(cur_pcb->term_idx);
+    }
     /* store virtual address in the ptr passed by user */
     *screen_start = (uint8_t *)MB_132;
 
-    /* find current process pcb and set video_mem_flag*/
-    uint32_t term_prog_num = terminals[cur_term_id].term_prog_counter;
-    uint32_t cur_pid = terminals[cur_term_id].prog_pids[term_prog_num - 1];
-    pcb_t* cur_pcb = FIND_PCB(cur_pid);
-    cur_pcb -> video_mem_flag = 1;
-
     return 0;
 }
 
@@ -1,10 +1,27 @@
 #ifndef _SYS_H
 #define _SYS_H
 
-#define FIND_PCB(pid) (pcb_t*) (PROG0_KSTACK_BOTTOM - (pid + 1) * KERNEL_STACK_SIZE);
+#include "types.h"
+#include "process.h"
+
+#define FIND_PCB(pid) (pid_table[(pid)])
 
 int32_t program_exception_flag;
 
+/* exec-to-first-instruction latency, [0] eager loading, [1] demand paging */
+typedef struct exec_stats {
+    uint32_t count;
+    uint32_t last_cycles;
+    uint64_t total_cycles;
+} exec_stats_t;
+
+exec_stats_t exec_stats[2];
+
+/* account the cycles from execute to a process's first instruction */
+void exec_timing_stop(pcb_t* pcb);
+/* print exec latency for both loading modes */
+void print_exec_stats();
+
 /* terminate a process */
 extern int32_t halt(uint8_t status);
 
@@ -12,8 +29,11 @@ extern int32_t halt(uint8_t status);
 extern int32_t execute(const uint8_t* command);
 int32_t _execute(const uint8_t* command);
 
+/* start a root program on a terminal, it runs once scheduled */
+int32_t spawn(const uint8_t* command, int32_t term);
+
 /* Jump to return of execute system call */
-int32_t jump_to_exec_ret(int32_t ebp, uint32_t status);
+int32_t jump_to_exec_ret(int32_t ebp, uint32_t status, pcb_t* parent);
 
 /* read data from the keyboard, a file, device (RTC), or directory */
 extern int32_t read(int32_t fd, void* buf, int32_t nbytes);
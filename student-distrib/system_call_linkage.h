@@ -5,6 +5,8 @@
 
 /* define the wrappers as functions */
 extern void System_Call     ();
+/* first return to user space of a spawned process */
+extern void ret_to_user     ();
 
 #endif /* ASM */
 #endif /* _SYS_LINK_H */
@@ -6,6 +6,13 @@
 #include "keyboard.h"
 #include "process.h"
 #include "system_call.h"
+#include "paging.h"
+#include "image_cache.h"
+#include "page_alloc.h"
+#include "scheduling.h"
+#include "slab.h"
+#include "ktime.h"
+#include "timer.h"
 
 #define PASS 1
 #define FAIL 0
@@ -68,6 +75,35 @@ static inline void assertion_failure(){
 				1. rtc_freq_change
 				2. rtc_invalid_freq
 
+		Performance Benchmarks:
+		7.1.1 - File System:
+				1. read_data_bench
+				2. dentry_lookup_bench
+				3. extent_cache_bench
+		7.2.1 - Process:
+				1. exec_latency_bench
+				2. image_cache_bench
+				3. pcb_alloc_bench
+				4. buddy_alloc_bench
+				5. kmalloc_bench
+		7.3.1 - Syscall:
+				1. current_lookup_bench
+				2. context_switch_bench
+				3. tlb_global_bench
+		7.4.1 - Terminal:
+				1. scroll_bench
+				2. terminal_write_bench
+				3. terminal_switch_bench
+				4. typeahead_bench
+		7.5.1 - RTC:
+				1. rtc_rate_bench
+				2. vrtc_timer_bench
+		7.6.1 - Time:
+				1. ktime_bench
+				2. time_page_bench
+		7.7.1 - Timers:
+				1. timer_wheel_bench
+
 	enter TEST_ID for corresponding test, 6.1.5.1 -> TEST_ID = 6151
 */
 
@@ -602,6 +638,1573 @@ int rtc_invalid_freq() {
 /* Checkpoint 4 tests */
 /* Checkpoint 5 tests */
 
+/* Performance benchmarks */
+
+#define BENCH_CHUNK			1024
+#define BENCH_REPS			64
+
+static uint8_t bench_buf[BENCH_CHUNK];
+static uint8_t bench_ref_buf[BENCH_CHUNK];
+
+/* 
+ * bench_kbps
+ *   DESCRIPTION: convert a byte count moved in 'cycles' TSC cycles to KB/s
+ *   INPUTS: bytes -- number of bytes moved
+ *           cycles -- elapsed TSC cycles
+ *           khz -- TSC frequency, tsc_khz
+ *   OUTPUTS: none
+ *   RETURN VALUE: throughput in KB/s, 0 if nothing was measured
+ *   SIDE EFFECTS: none
+ */
+static uint32_t bench_kbps(uint32_t bytes, uint64_t cycles, uint32_t khz) {
+	uint32_t us = (uint32_t)div_u64_u32(cycles * 1000, khz, NULL);
+	if (!us)
+		return 0;
+	/* 1000000 us per second, 1024 bytes per KB */
+	return (uint32_t)div_u64_u32(((uint64_t)bytes * 1000000) >> 10, us, NULL);
+}
+
+/* 
+ * read_data_bytewise
+ *   DESCRIPTION: the original byte-at-a-time read_data, kept here only as
+ *                the baseline for read_data_bench
+ *   INPUTS: same as read_data
+ *   OUTPUTS: none
+ *   RETURN VALUE: same as the original read_data
+ *   SIDE EFFECTS: none
+ */
+static int32_t read_data_bytewise(uint32_t inode, uint32_t offset, uint8_t* buf, int32_t length) {
+	if (inode >= inode_num || buf == NULL || length < 0)
+		return -1;
+	inode_t* inode_struct = ((inode_t*)file_system_addr + inode + 1);
+	uint32_t i;
+	for (i = offset; i < (offset + length); i++) {
+		uint32_t block_idx = *(inode_struct->block_idx + i / DATA_LENGTH);
+		if (block_idx >= block_num)
+			return i - offset - 1;
+		data_block_t* data_struct = ((data_block_t*)file_system_addr + 1 + inode_num + block_idx);
+		*(buf++) = *(data_struct->data + i % DATA_LENGTH);
+		if (i == (inode_struct->length))
+			return i - offset;
+	}
+	return i - offset;
+}
+
+/* 
+ * bench_read_file
+ *   DESCRIPTION: read a whole file BENCH_REPS times in BENCH_CHUNK pieces,
+ *                the way cat does
+ *   INPUTS: inode -- inode of the file
+ *           size -- file size in bytes
+ *           reader -- read_data implementation to time
+ *   OUTPUTS: none
+ *   RETURN VALUE: elapsed TSC cycles
+ *   SIDE EFFECTS: overwrites bench_buf
+ */
+static uint64_t bench_read_file(uint32_t inode, uint32_t size,
+		int32_t (*reader)(uint32_t, uint32_t, uint8_t*, int32_t)) {
+	uint32_t rep, offset;
+	uint64_t start = rdtsc();
+	for (rep = 0; rep < BENCH_REPS; rep++) {
+		for (offset = 0; offset < size; offset += BENCH_CHUNK)
+			reader(inode, offset, bench_buf, BENCH_CHUNK);
+	}
+	return rdtsc() - start;
+}
+
+/* 
+ * read_data_bench
+ *   DESCRIPTION: benchmark 7.1.1 - read_data throughput
+ *                read every regular file in filesys_img with the old
+ *                byte-wise path and the block-wise path, check that both
+ *                return the same bytes, and print KB/s for each
+ *   INPUTS: none
+ *   OUTPUTS: one line per file
+ *   RETURN VALUE: PASS if both paths agree on every file
+ *   SIDE EFFECTS: none
+ */
+int read_data_bench() {
+	TEST_HEADER;
+	int result = PASS;
+	uint32_t khz = tsc_khz;
+	uint32_t idx, offset, size;
+	int32_t count, i;
+	uint64_t old_cycles, new_cycles;
+	uint8_t name[NAME_LENGTH_MAX + 1];
+	dentry_t dentry;
+
+	printf("TSC: %u kHz\n", khz);
+	for (idx = 0; read_dentry_by_index(idx, &dentry) == 0; idx++) {
+		if (dentry.file_type != 2)
+			continue;
+		size = get_file_size(&dentry);
+
+		/* the new path must return the same bytes as the old one */
+		for (offset = 0; offset < size; offset += BENCH_CHUNK) {
+			count = read_data(dentry.inode_idx, offset, bench_buf, BENCH_CHUNK);
+			read_data_bytewise(dentry.inode_idx, offset, bench_ref_buf, BENCH_CHUNK);
+			for (i = 0; i < count; i++) {
+				if (bench_buf[i] != bench_ref_buf[i])
+					result = FAIL;
+			}
+		}
+
+		old_cycles = bench_read_file(dentry.inode_idx, size, read_data_bytewise);
+		new_cycles = bench_read_file(dentry.inode_idx, size, read_data);
+
+		strncpy((int8_t*)name, (int8_t*)dentry.file_name, NAME_LENGTH_MAX);
+		name[NAME_LENGTH_MAX] = '\0';
+		printf("%s (%u B): old %u KB/s, new %u KB/s\n", name, size,
+			bench_kbps(size * BENCH_REPS, old_cycles, khz),
+			bench_kbps(size * BENCH_REPS, new_cycles, khz));
+	}
+	return result;
+}
+
+/* 
+ * read_dentry_by_name_linear
+ *   DESCRIPTION: the original linear boot block scan, kept here only as
+ *                the baseline for dentry_lookup_bench
+ *   INPUTS: same as read_dentry_by_name
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 if found, -1 if not
+ *   SIDE EFFECTS: none
+ */
+static int32_t read_dentry_by_name_linear(const uint8_t* fname, dentry_t* dentry) {
+	if (fname == NULL || dentry == NULL || strlen((int8_t*)fname) > 32)
+		return -1;
+	uint32_t dentry_idx;
+	dentry_t* dentry_addr = (dentry_t *)file_system_addr;
+	for (dentry_idx = 0; dentry_idx < dentry_num; dentry_idx++) {
+		dentry_addr++;
+		if (!strncmp((int8_t *)fname, (int8_t *)dentry_addr->file_name, NAME_LENGTH_MAX)) {
+			*dentry = *dentry_addr;
+			return 0;
+		}
+	}
+	return -1;
+}
+
+#define LOOKUP_REPS		1000
+
+/* 
+ * dentry_lookup_bench
+ *   DESCRIPTION: benchmark 7.1.2 - file name lookup latency
+ *                look up every file name (plus one missing name) with the
+ *                linear scan and with the dentry hash, and check that both
+ *                find the same dentry, including 32-byte names with no NUL
+ *   INPUTS: none
+ *   OUTPUTS: average cycles per lookup for both paths, then fs counters
+ *   RETURN VALUE: PASS if both paths agree
+ *   SIDE EFFECTS: none
+ */
+int dentry_lookup_bench() {
+	TEST_HEADER;
+	int result = PASS;
+	uint32_t idx, rep, names = 0;
+	uint64_t linear_cycles = 0, hash_cycles = 0, start;
+	uint8_t name[NAME_LENGTH_MAX + 1];
+	dentry_t dentry, linear_dentry, hash_dentry;
+
+	for (idx = 0; read_dentry_by_index(idx, &dentry) == 0; idx++) {
+		strncpy((int8_t*)name, (int8_t*)dentry.file_name, NAME_LENGTH_MAX);
+		name[NAME_LENGTH_MAX] = '\0';
+		if (read_dentry_by_name_linear(name, &linear_dentry) ||
+			read_dentry_by_name(name, &hash_dentry) ||
+			linear_dentry.inode_idx != hash_dentry.inode_idx)
+			result = FAIL;
+
+		start = rdtsc();
+		for (rep = 0; rep < LOOKUP_REPS; rep++)
+			read_dentry_by_name_linear(name, &linear_dentry);
+		linear_cycles += rdtsc() - start;
+
+		start = rdtsc();
+		for (rep = 0; rep < LOOKUP_REPS; rep++)
+			read_dentry_by_name(name, &hash_dentry);
+		hash_cycles += rdtsc() - start;
+		names++;
+	}
+	if (read_dentry_by_name((uint8_t*)"nosuchfile", &hash_dentry) != -1)
+		result = FAIL;
+	if (!names)
+		return FAIL;
+
+	printf("%u names, linear %u cycles/lookup, hashed %u cycles/lookup\n", names,
+		(uint32_t)div_u64_u32(linear_cycles, names * LOOKUP_REPS, NULL),
+		(uint32_t)div_u64_u32(hash_cycles, names * LOOKUP_REPS, NULL));
+	print_fs_stats();
+	return result;
+}
+
+/* 
+ * extent_cache_bench
+ *   DESCRIPTION: benchmark 7.1.3 - extent map cache
+ *                read every regular file once with a cold extent cache and
+ *                BENCH_REPS times with a warm one, the way cat reads
+ *   INPUTS: none
+ *   OUTPUTS: cold and warm cycles per pass for each file, then fs counters
+ *   RETURN VALUE: PASS if warm reads hit the cache
+ *   SIDE EFFECTS: flushes the extent cache
+ */
+int extent_cache_bench() {
+	TEST_HEADER;
+	uint32_t idx, offset, size;
+	uint32_t hits_before;
+	uint64_t cold_cycles, warm_cycles, start;
+	uint8_t name[NAME_LENGTH_MAX + 1];
+	dentry_t dentry;
+
+	for (idx = 0; read_dentry_by_index(idx, &dentry) == 0; idx++) {
+		if (dentry.file_type != 2)
+			continue;
+		size = get_file_size(&dentry);
+
+		extent_cache_flush();
+		start = rdtsc();
+		for (offset = 0; offset < size; offset += BENCH_CHUNK)
+			read_data(dentry.inode_idx, offset, bench_buf, BENCH_CHUNK);
+		cold_cycles = rdtsc() - start;
+
+		hits_before = fs_stats.extent_hits;
+		warm_cycles = bench_read_file(dentry.inode_idx, size, read_data);
+		if (size && fs_stats.extent_hits == hits_before)
+			return FAIL;
+
+		strncpy((int8_t*)name, (int8_t*)dentry.file_name, NAME_LENGTH_MAX);
+		name[NAME_LENGTH_MAX] = '\0';
+		printf("%s: cold %u cycles, warm %u cycles/pass\n", name, (uint32_t)cold_cycles,
+			(uint32_t)div_u64_u32(warm_cycles, BENCH_REPS, NULL));
+	}
+	print_fs_stats();
+	return PASS;
+}
+
+/* 
+ * exec_latency_bench
+ *   DESCRIPTION: benchmark 7.2.1 - exec-to-first-instruction latency
+ *                load every executable into a scratch pcb eagerly (every
+ *                segment filled) and with demand paging (page table reset,
+ *                then only the entry page filled, as the first fault would),
+ *                and check that both put the same bytes at the entry point
+ *   INPUTS: none
+ *   OUTPUTS: eager and demand cycles for each executable
+ *   RETURN VALUE: PASS if both modes agree
+ *   SIDE EFFECTS: uses a scratch pcb and the program page, must run before
+ *                 any process is started; leaves demand_paging set
+ */
+int exec_latency_bench() {
+	TEST_HEADER;
+	int result = PASS;
+	uint32_t idx, eip, i;
+	uint8_t* page;
+	uint64_t eager_cycles, demand_cycles, start;
+	uint8_t name[NAME_LENGTH_MAX + 1];
+	dentry_t dentry;
+	program_info_t info;
+	pcb_t* pcb = alloc_pcb();
+
+	if (pcb == NULL)
+		return FAIL;
+	load_page_directory(pcb->page_dir);
+	for (idx = 0; read_dentry_by_index(idx, &dentry) == 0; idx++) {
+		if (check_validity(&dentry, &info) == -1)
+			continue;
+		eip = info.entry;
+
+		demand_paging = 0;
+		start = rdtsc();
+		if (program_loader(&info, pcb) == -1)
+			result = FAIL;
+		eager_cycles = rdtsc() - start;
+		image_cache_put(pcb->exec_image);
+		memcpy(bench_ref_buf, (void*)(eip & PAGE_MASK), BENCH_CHUNK);
+
+		demand_paging = 1;
+		start = rdtsc();
+		if (program_loader(&info, pcb) == -1 || program_fill_page(pcb, eip) == -1)
+			result = FAIL;
+		demand_cycles = rdtsc() - start;
+		image_cache_put(pcb->exec_image);
+		page = (uint8_t*)(eip & PAGE_MASK);
+		for (i = 0; i < BENCH_CHUNK; i++) {
+			if (page[i] != bench_ref_buf[i])
+				result = FAIL;
+		}
+
+		strncpy((int8_t*)name, (int8_t*)dentry.file_name, NAME_LENGTH_MAX);
+		name[NAME_LENGTH_MAX] = '\0';
+		printf("%s: eager %u cycles, demand %u cycles\n", name,
+			(uint32_t)eager_cycles, (uint32_t)demand_cycles);
+	}
+	load_page_directory(page_directory);
+	free_pcb(pcb);
+	return result;
+}
+
+/* 
+ * image_load_all
+ *   DESCRIPTION: load an executable into a scratch pcb with demand paging and
+ *                fault in every segment page, the way a run touching all of
+ *                it would
+ *   INPUTS: info -- the executable, from check_validity
+ *           pcb -- scratch pcb from alloc_pcb
+ *   OUTPUTS: none
+ *   RETURN VALUE: elapsed TSC cycles, 0 if loading failed
+ *   SIDE EFFECTS: pins the image in pcb->exec_image
+ */
+static uint64_t image_load_all(program_info_t* info, pcb_t* pcb) {
+	uint32_t vaddr, i;
+	prog_segment_t* seg;
+	uint64_t start = rdtsc();
+	if (program_loader(info, pcb) == -1)
+		return 0;
+	for (i = 0; i < info->seg_count; i++) {
+		seg = &info->segs[i];
+		for (vaddr = seg->vaddr & PAGE_MASK; vaddr < seg->vaddr + seg->memsz; vaddr += PAGE_SIZE) {
+			if (program_fill_page(pcb, vaddr) == -1)
+				return 0;
+		}
+	}
+	return rdtsc() - start;
+}
+
+/* 
+ * image_cache_bench
+ *   DESCRIPTION: benchmark 7.2.2 - executable image cache
+ *                load shell twice into a scratch pcb, once with an empty
+ *                image cache and once with shell cached, and count the
+ *                file pages read and private frames each launch needed;
+ *                then check that the entry page is shared read-only text
+ *                that a write may not copy
+ *   INPUTS: none
+ *   OUTPUTS: cold and warm cycles and page counts, then image counters
+ *   RETURN VALUE: PASS if the warm launch reads nothing and shares text
+ *   SIDE EFFECTS: uses a scratch pcb and the program page, must run before
+ *                 any process is started; flushes the image cache
+ */
+int image_cache_bench() {
+	TEST_HEADER;
+	int result = PASS;
+	uint32_t private_before, fills_before;
+	uint64_t cold_cycles, warm_cycles;
+	dentry_t dentry;
+	program_info_t info;
+	pcb_t* pcb;
+
+	if (read_dentry_by_name((uint8_t*)"shell", &dentry) == -1 || check_validity(&dentry, &info) == -1)
+		return FAIL;
+	if ((pcb = alloc_pcb()) == NULL)
+		return FAIL;
+	load_page_directory(pcb->page_dir);
+	demand_paging = 1;
+	image_cache_flush();
+
+	private_before = image_stats.private_pages;
+	fills_before = image_stats.page_fills;
+	cold_cycles = image_load_all(&info, pcb);
+	image_cache_put(pcb->exec_image);
+	printf("cold: %u cycles, %u pages read, %u private pages\n", (uint32_t)cold_cycles,
+		image_stats.page_fills - fills_before, image_stats.private_pages - private_before);
+
+	private_before = image_stats.private_pages;
+	fills_before = image_stats.page_fills;
+	warm_cycles = image_load_all(&info, pcb);
+	printf("warm: %u cycles, %u pages read, %u private pages\n", (uint32_t)warm_cycles,
+		image_stats.page_fills - fills_before, image_stats.private_pages - private_before);
+	if (!cold_cycles || !warm_cycles || image_stats.page_fills != fills_before)
+		result = FAIL;
+
+	/* text is shared and a write to it is an error, not a copy */
+	if (!is_shared_page(pcb->prog_table, info.entry) || is_cow_page(pcb->prog_table, info.entry) ||
+		program_cow_page(pcb, info.entry) != -1)
+		result = FAIL;
+	image_cache_put(pcb->exec_image);
+	print_image_stats();
+	print_tlb_stats();
+
+	load_page_directory(page_directory);
+	free_pcb(pcb);
+	return result;
+}
+
+static pcb_t* bench_pcbs[PID_MAX];
+
+/* 
+ * pcb_alloc_bench
+ *   DESCRIPTION: benchmark 7.2.3 - process allocation
+ *                allocate pcbs until pids or memory run out, check that
+ *                every pid is distinct and FIND_PCB maps it back, then
+ *                free them all and check that every frame came back
+ *   INPUTS: none
+ *   OUTPUTS: how many processes fit, cycles per alloc and per free
+ *   RETURN VALUE: PASS if the table and allocators are consistent
+ *   SIDE EFFECTS: must run before any process is started
+ */
+int pcb_alloc_bench() {
+	TEST_HEADER;
+	int result = PASS;
+	uint32_t count, i, free_before = page_stats.free_frames;
+	uint64_t alloc_cycles, free_cycles, start;
+
+	start = rdtsc();
+	for (count = 0; count < PID_MAX; count++) {
+		if ((bench_pcbs[count] = alloc_pcb()) == NULL)
+			break;
+	}
+	alloc_cycles = rdtsc() - start;
+	if (count < 2)
+		return FAIL;
+
+	for (i = 0; i < count; i++) {
+		if (FIND_PCB(bench_pcbs[i]->pid) != bench_pcbs[i] ||
+			((uint32_t)bench_pcbs[i] & (KERNEL_STACK_SIZE - 1)))
+			result = FAIL;
+	}
+
+	start = rdtsc();
+	for (i = 0; i < count; i++)
+		free_pcb(bench_pcbs[i]);
+	free_cycles = rdtsc() - start;
+
+	printf("%u processes fit, alloc %u cycles, free %u cycles\n", count,
+		(uint32_t)div_u64_u32(alloc_cycles, count, NULL),
+		(uint32_t)div_u64_u32(free_cycles, count, NULL));
+	print_process_stats();
+	/* the pcb and file array caches keep at most one empty slab each */
+	if (page_stats.free_frames + (1 << 3) + 1 < free_before)
+		result = FAIL;
+	return result;
+}
+
+#define BUDDY_BLOCKS	64
+#define BUDDY_ORDERS	6
+
+static uint32_t buddy_blocks[BUDDY_BLOCKS];
+
+/* 
+ * buddy_alloc_bench
+ *   DESCRIPTION: benchmark 7.2.4 - buddy page allocator
+ *                allocate blocks of orders 0 to 5 in turn, check their
+ *                alignment, free them interleaved so buddies merge late,
+ *                and check that the free lists end up as they started.
+ *                Then free a merged block again and free a block with the
+ *                wrong order, both of which must be refused
+ *   INPUTS: none
+ *   OUTPUTS: cycles per alloc and per free, then allocator statistics
+ *   RETURN VALUE: PASS if every block was aligned, every merge happened
+ *                 and the bad frees left the free lists alone
+ *   SIDE EFFECTS: none
+ */
+int buddy_alloc_bench() {
+	TEST_HEADER;
+	int result = PASS;
+	uint32_t i, order, block, bad_before;
+	uint32_t free_before = page_stats.free_frames;
+	uint32_t blocks_before[PAGE_MAX_ORDER + 1];
+	uint64_t alloc_cycles, free_cycles, start;
+
+	memcpy(blocks_before, page_stats.free_blocks, sizeof(blocks_before));
+	start = rdtsc();
+	for (i = 0; i < BUDDY_BLOCKS; i++)
+		buddy_blocks[i] = page_alloc(i % BUDDY_ORDERS);
+	alloc_cycles = rdtsc() - start;
+	for (i = 0; i < BUDDY_BLOCKS; i++) {
+		order = i % BUDDY_ORDERS;
+		if (!buddy_blocks[i] || (buddy_blocks[i] & ((PAGE_SIZE << order) - 1)))
+			result = FAIL;
+	}
+
+	start = rdtsc();
+	for (i = 0; i < BUDDY_BLOCKS; i += 2)
+		page_free(buddy_blocks[i], i % BUDDY_ORDERS);
+	for (i = 1; i < BUDDY_BLOCKS; i += 2)
+		page_free(buddy_blocks[i], i % BUDDY_ORDERS);
+	free_cycles = rdtsc() - start;
+
+	printf("alloc %u cycles, free %u cycles\n",
+		(uint32_t)div_u64_u32(alloc_cycles, BUDDY_BLOCKS, NULL),
+		(uint32_t)div_u64_u32(free_cycles, BUDDY_BLOCKS, NULL));
+	print_page_stats();
+	if (page_stats.free_frames != free_before)
+		result = FAIL;
+	for (order = 0; order <= PAGE_MAX_ORDER; order++) {
+		if (page_stats.free_blocks[order] != blocks_before[order])
+			result = FAIL;
+	}
+
+	/* an order-0 frame merged into a bigger free block, then a live
+	 * order-1 block freed as order 0 */
+	bad_before = page_stats.bad_frees;
+	page_free(buddy_blocks[0], 0);
+	if ((block = page_alloc(1)) == 0)
+		return FAIL;
+	page_free(block, 0);
+	page_free(block + PAGE_SIZE, 0);
+	if (page_stats.bad_frees != bad_before + 3 ||
+		page_stats.free_frames + (1 << 1) != free_before)
+		result = FAIL;
+	page_free(block, 1);
+	if (page_stats.free_frames != free_before)
+		result = FAIL;
+	return result;
+}
+
+#define KMALLOC_OBJS	512
+/* one empty slab kept per size class: 4 + 2 + 6 * 1 frames */
+#define KMALLOC_KEPT_FRAMES	12
+
+static uint8_t* kmalloc_objs[KMALLOC_OBJS];
+
+/* 
+ * kmalloc_bench
+ *   DESCRIPTION: benchmark 7.2.5 - slab kmalloc
+ *                allocate objects cycling through every size class, tag
+ *                each one so overlaps show up, free them and check that
+ *                the caches gave their slabs back
+ *   INPUTS: none
+ *   OUTPUTS: cycles per kmalloc and per kfree, then every cache's counters
+ *   RETURN VALUE: PASS if every object was aligned, intact, and at most one
+ *                 empty slab per size class is left
+ *   SIDE EFFECTS: none
+ */
+int kmalloc_bench() {
+	TEST_HEADER;
+	int result = PASS;
+	uint32_t i, size;
+	uint32_t free_before = page_stats.free_frames;
+	uint64_t alloc_cycles, free_cycles, start;
+
+	start = rdtsc();
+	for (i = 0; i < KMALLOC_OBJS; i++)
+		kmalloc_objs[i] = kmalloc(16 << (i % KMALLOC_CLASSES));
+	alloc_cycles = rdtsc() - start;
+
+	for (i = 0; i < KMALLOC_OBJS; i++) {
+		size = 16 << (i % KMALLOC_CLASSES);
+		if (kmalloc_objs[i] == NULL || ((uint32_t)kmalloc_objs[i] & (size - 1)))
+			return FAIL;
+		memset(kmalloc_objs[i], i & 0xFF, size);
+	}
+	for (i = 0; i < KMALLOC_OBJS; i++) {
+		size = 16 << (i % KMALLOC_CLASSES);
+		if (kmalloc_objs[i][0] != (i & 0xFF) || kmalloc_objs[i][size - 1] != (i & 0xFF))
+			result = FAIL;
+	}
+
+	start = rdtsc();
+	for (i = 0; i < KMALLOC_OBJS; i++)
+		kfree(kmalloc_objs[i]);
+	free_cycles = rdtsc() - start;
+
+	printf("kmalloc %u cycles, kfree %u cycles\n",
+		(uint32_t)div_u64_u32(alloc_cycles, KMALLOC_OBJS, NULL),
+		(uint32_t)div_u64_u32(free_cycles, KMALLOC_OBJS, NULL));
+	print_slab_stats();
+	if (page_stats.free_frames + KMALLOC_KEPT_FRAMES < free_before)
+		result = FAIL;
+	return result;
+}
+
+#define LOOKUP_LOOPS	100000
+#define SYS_GETARGS		7
+
+/* 
+ * lookup_by_terminal
+ *   DESCRIPTION: the old way to find the running pcb: through the
+ *                scheduled terminal's newest pid and the pid table, kept
+ *                here only as the baseline for current_lookup_bench
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: pcb of the scheduled terminal's newest process
+ *   SIDE EFFECTS: none
+ */
+static pcb_t* lookup_by_terminal() {
+	volatile int32_t* term_id = &cur_term_id;
+	return FIND_PCB(((volatile terminal_t*)terminals)[*term_id].top_pid);
+}
+
+static uint64_t lookup_cycles[3];
+
+/* 
+ * lookup_bench_body
+ *   DESCRIPTION: time both lookups and a full getargs syscall; runs on the
+ *                scratch pcb's kernel stack so current is meaningful
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 if every lookup found the scratch pcb, -1 if not
+ *   SIDE EFFECTS: fills lookup_cycles
+ */
+static int32_t lookup_bench_body() {
+	uint32_t i;
+	int32_t ok = 0, ret;
+	pcb_t* expect = current;
+	pcb_t* volatile found;
+	uint8_t args[PARAMS_LEN];
+	uint64_t start;
+
+	start = rdtsc();
+	for (i = 0; i < LOOKUP_LOOPS; i++)
+		found = lookup_by_terminal();
+	lookup_cycles[0] = rdtsc() - start;
+	if (found != expect)
+		ok = -1;
+
+	start = rdtsc();
+	for (i = 0; i < LOOKUP_LOOPS; i++)
+		found = current;
+	lookup_cycles[1] = rdtsc() - start;
+	if (found != expect)
+		ok = -1;
+
+	start = rdtsc();
+	for (i = 0; i < LOOKUP_LOOPS; i++) {
+		asm volatile ("int $0x80"
+			: "=a"(ret)
+			: "a"(SYS_GETARGS), "b"(args), "c"(PARAMS_LEN)
+			: "memory", "cc"
+		);
+	}
+	lookup_cycles[2] = rdtsc() - start;
+	if (ret != 0 || strncmp((int8_t*)args, (int8_t*)"bench", PARAMS_LEN))
+		ok = -1;
+	return ok;
+}
+
+/* 
+ * current_lookup_bench
+ *   DESCRIPTION: benchmark 7.3.1 - current-process lookup
+ *                compare the terminal/pid-table lookup with masking esp,
+ *                and time a getargs syscall, which now uses current
+ *   INPUTS: none
+ *   OUTPUTS: cycles per lookup for both, cycles per getargs
+ *   RETURN VALUE: PASS if both lookups and getargs find the scratch pcb
+ *   SIDE EFFECTS: must run before any process is started; borrows
+ *                 terminal 0's newest pid while it runs
+ */
+int current_lookup_bench() {
+	TEST_HEADER;
+	int32_t ok;
+	uint32_t stack_top;
+	int32_t (*body)() = lookup_bench_body;
+	pcb_t* pcb = alloc_pcb();
+
+	if (pcb == NULL)
+		return FAIL;
+	stack_top = KSTACK_TOP(pcb);
+	strcpy((int8_t*)pcb->params, (int8_t*)"bench");
+	cur_term_id = 0;
+	terminals[0].top_pid = pcb->pid;
+
+	/* switch onto the scratch pcb's kernel stack for the measurement */
+	asm volatile (
+		"movl %%esp, %%ebx;"
+		"movl %1, %%esp;"
+		"call *%2;"
+		"movl %%ebx, %%esp;"
+		: "=a"(ok), "+c"(stack_top), "+d"(body)
+		:
+		: "ebx", "memory", "cc"
+	);
+
+	terminals[0].top_pid = -1;
+	free_pcb(pcb);
+	printf("terminal lookup %u cycles, esp mask %u cycles, getargs %u cycles\n",
+		(uint32_t)div_u64_u32(lookup_cycles[0], LOOKUP_LOOPS, NULL),
+		(uint32_t)div_u64_u32(lookup_cycles[1], LOOKUP_LOOPS, NULL),
+		(uint32_t)div_u64_u32(lookup_cycles[2], LOOKUP_LOOPS, NULL));
+	return (ok == 0) ? PASS : FAIL;
+}
+
+#define PINGPONG_ROUNDS	10000
+
+static pcb_t* pp_main;
+static pcb_t* pp_ping;
+static pcb_t* pp_pong;
+static volatile uint32_t pp_count;
+
+/* 
+ * pingpong_ping
+ *   DESCRIPTION: hand the cpu to pong PINGPONG_ROUNDS times, then back to
+ *                the benchmark
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none, never returns
+ *   SIDE EFFECTS: none
+ */
+static void pingpong_ping() {
+	uint32_t i;
+	for (i = 0; i < PINGPONG_ROUNDS; i++)
+		switch_to(pp_ping, pp_pong);
+	switch_to(pp_ping, pp_main);
+}
+
+/* 
+ * pingpong_pong
+ *   DESCRIPTION: count a round and hand the cpu straight back to ping
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none, never returns
+ *   SIDE EFFECTS: increments pp_count
+ */
+static void pingpong_pong() {
+	while (1) {
+		pp_count++;
+		switch_to(pp_pong, pp_ping);
+	}
+}
+
+/* 
+ * pingpong_start
+ *   DESCRIPTION: give a scratch pcb a kernel context that switch_to
+ *                resumes at entry, on the pcb's own kernel stack
+ *   INPUTS: pcb -- scratch pcb
+ *           entry -- function to run, must never return
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void pingpong_start(pcb_t* pcb, void (*entry)()) {
+	uint32_t* sp = (uint32_t*)KSTACK_TOP(pcb);
+	/* return address slot, entry never returns */
+	*--sp = 0;
+	pcb->thread.esp = (uint32_t)sp;
+	pcb->thread.eip = (uint32_t)entry;
+}
+
+/* 
+ * context_switch_bench
+ *   DESCRIPTION: benchmark 7.3.2 - switch_to cost
+ *                two scratch kernel threads hand the cpu back and forth
+ *                with switch_to, timed with rdtsc over all handoffs
+ *   INPUTS: none
+ *   OUTPUTS: cycles per switch and per round trip
+ *   RETURN VALUE: PASS if pong ran once per round
+ *   SIDE EFFECTS: must run before any process is started
+ */
+int context_switch_bench() {
+	TEST_HEADER;
+	uint64_t start, cycles;
+	uint32_t esp0 = tss.esp0;
+	uint32_t switches = 2 * PINGPONG_ROUNDS + 2;
+
+	pp_main = alloc_pcb();
+	pp_ping = alloc_pcb();
+	pp_pong = alloc_pcb();
+	if (pp_main == NULL || pp_ping == NULL || pp_pong == NULL)
+		return FAIL;
+	pp_count = 0;
+	pingpong_start(pp_ping, pingpong_ping);
+	pingpong_start(pp_pong, pingpong_pong);
+
+	start = rdtsc();
+	switch_to(pp_main, pp_ping);
+	cycles = rdtsc() - start;
+
+	tss.esp0 = esp0;
+	free_pcb(pp_pong);
+	free_pcb(pp_ping);
+	free_pcb(pp_main);
+	printf("%u switches, %u cycles per switch, %u cycles per round trip\n",
+		switches,
+		(uint32_t)div_u64_u32(cycles, switches, NULL),
+		(uint32_t)div_u64_u32(cycles, PINGPONG_ROUNDS, NULL));
+	return (pp_count == PINGPONG_ROUNDS) ? PASS : FAIL;
+}
+
+#define TLB_LOOPS		10000
+#define CR4_PGE			0x80
+
+/* 
+ * read_cr4
+ *   DESCRIPTION: read the control register holding PGE
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: cr4
+ *   SIDE EFFECTS: none
+ */
+static uint32_t read_cr4() {
+	uint32_t cr4;
+	asm volatile ("movl %%cr4, %0" : "=r"(cr4));
+	return cr4;
+}
+
+/* 
+ * write_cr4
+ *   DESCRIPTION: write the control register holding PGE
+ *   INPUTS: cr4 -- new value
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: clearing PGE flushes global tlb entries
+ */
+static void write_cr4(uint32_t cr4) {
+	asm volatile ("movl %0, %%cr4" : : "r"(cr4) : "memory");
+}
+
+/* 
+ * tlb_syscall_loop
+ *   DESCRIPTION: reload cr3, as a context switch does, then make a system
+ *                call (an invalid number, so only the entry path runs)
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: elapsed TSC cycles for TLB_LOOPS rounds
+ *   SIDE EFFECTS: none
+ */
+static uint64_t tlb_syscall_loop() {
+	uint32_t i;
+	int32_t ret;
+	uint64_t start = rdtsc();
+	for (i = 0; i < TLB_LOOPS; i++) {
+		flush_tlb();
+		asm volatile ("int $0x80"
+			: "=a"(ret)
+			: "a"(0)
+			: "memory", "cc"
+		);
+	}
+	return rdtsc() - start;
+}
+
+/* 
+ * tlb_global_bench
+ *   DESCRIPTION: benchmark 7.3.3 - global kernel mappings
+ *                time cr3 reload + syscall rounds with CR4.PGE on, where the
+ *                kernel, VGA and pool entries survive the reload, and off,
+ *                where the syscall path walks the page tables again
+ *   INPUTS: none
+ *   OUTPUTS: cycles per round for both
+ *   RETURN VALUE: PASS if PGE was on and is restored
+ *   SIDE EFFECTS: none
+ */
+int tlb_global_bench() {
+	TEST_HEADER;
+	uint64_t global_cycles, local_cycles;
+	uint32_t cr4 = read_cr4();
+
+	global_cycles = tlb_syscall_loop();
+	write_cr4(cr4 & ~CR4_PGE);
+	local_cycles = tlb_syscall_loop();
+	write_cr4(cr4);
+
+	printf("global kernel pages %u cycles, non-global %u cycles per round\n",
+		(uint32_t)div_u64_u32(global_cycles, TLB_LOOPS, NULL),
+		(uint32_t)div_u64_u32(local_cycles, TLB_LOOPS, NULL));
+	return ((cr4 & CR4_PGE) && read_cr4() == cr4) ? PASS : FAIL;
+}
+
+#define SCROLL_LINES	2000
+#define SCROLL_TEXT		"scroll_bench"
+
+/* 
+ * scroll_lines
+ *   DESCRIPTION: print SCROLL_LINES short lines on the displayed terminal,
+ *                each one scrolling the screen
+ *   INPUTS: none
+ *   OUTPUTS: the lines
+ *   RETURN VALUE: TSC cycles taken
+ *   SIDE EFFECTS: none
+ */
+static uint64_t scroll_lines() {
+	uint64_t start = rdtsc();
+	uint32_t i;
+	for (i = 0; i < SCROLL_LINES; i++)
+		puts(SCROLL_TEXT "\n");
+	return rdtsc() - start;
+}
+
+/* 
+ * copy_scroll_lines
+ *   DESCRIPTION: the old way to print a line at the bottom: write it into
+ *                VGA and move every row up a byte at a time, kept here
+ *                only as the baseline for scroll_bench
+ *   INPUTS: none
+ *   OUTPUTS: the lines, straight into VGA at the start of the window
+ *   RETURN VALUE: TSC cycles taken
+ *   SIDE EFFECTS: none
+ */
+static uint64_t copy_scroll_lines() {
+	uint64_t start = rdtsc();
+	int8_t* text = SCROLL_TEXT;
+	uint32_t i;
+	int32_t j, offset;
+	for (i = 0; i < SCROLL_LINES; i++) {
+		for (j = 0; text[j]; j++) {
+			offset = (NUM_ROWS - 1) * NUM_COLS + j;
+			*(uint8_t *)(VIDEO + (offset << 1)) = text[j];
+			*(uint8_t *)(VIDEO + (offset << 1) + 1) = ATTRIB;
+		}
+		for (offset = 0; offset < (NUM_ROWS - 1) * NUM_COLS; offset++) {
+			*(uint8_t *)(VIDEO + (offset << 1)) = *(uint8_t *)(VIDEO + ((offset + NUM_COLS) << 1));
+			*(uint8_t *)(VIDEO + (offset << 1) + 1) = ATTRIB;
+		}
+		for (; offset < NUM_ROWS * NUM_COLS; offset++) {
+			*(uint8_t *)(VIDEO + (offset << 1)) = 0;
+			*(uint8_t *)(VIDEO + (offset << 1) + 1) = ATTRIB;
+		}
+	}
+	return rdtsc() - start;
+}
+
+/* 
+ * scroll_bench
+ *   DESCRIPTION: benchmark 7.4.1 - hardware scrolling
+ *                print lines with the screen scrolled by the CRTC start
+ *                address, then with the old copying scroll
+ *   INPUTS: none
+ *   OUTPUTS: lines per second for both
+ *   RETURN VALUE: PASS if the last line ends up just above the cursor
+ *   SIDE EFFECTS: clears the screen
+ */
+int scroll_bench() {
+	TEST_HEADER;
+	int result = PASS;
+	uint32_t khz = tsc_khz;
+	uint32_t hw_cpl, sw_cpl;
+	uint8_t* last_line;
+
+	hw_cpl = (uint32_t)div_u64_u32(scroll_lines(), SCROLL_LINES, NULL);
+	last_line = (uint8_t*)(VIDEO + ((vga_start + (NUM_ROWS - 2) * NUM_COLS) << 1));
+	if (*last_line != 's')
+		result = FAIL;
+
+	set_vga_start(0);
+	sw_cpl = (uint32_t)div_u64_u32(copy_scroll_lines(), SCROLL_LINES, NULL);
+	last_line = (uint8_t*)(VIDEO + ((NUM_ROWS - 2) * NUM_COLS << 1));
+	if (*last_line != 's')
+		result = FAIL;
+	/* VGA no longer matches the RAM screen */
+	clear();
+
+	printf("hardware scroll %u lines/s, copying scroll %u lines/s\n",
+		(uint32_t)div_u64_u32((uint64_t)khz * 1000, hw_cpl ? hw_cpl : 1, NULL),
+		(uint32_t)div_u64_u32((uint64_t)khz * 1000, sw_cpl ? sw_cpl : 1, NULL));
+	return result;
+}
+
+#define WRITE_BUF_SIZE	4096
+#define WRITE_REPS		16
+#define WRITE_LINE		64
+
+static int8_t write_buf[WRITE_BUF_SIZE];
+
+/* 
+ * putc_write
+ *   DESCRIPTION: the old terminal_write, one putc and cursor update per
+ *                byte, kept here only as the baseline for
+ *                terminal_write_bench
+ *   INPUTS: buf -- characters to write
+ *           nbytes -- number of bytes
+ *   OUTPUTS: the characters on the scheduled terminal
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void putc_write(int8_t* buf, int32_t nbytes) {
+	int32_t idx;
+	for (idx = 0; idx < nbytes; idx++) {
+		if (!buf[idx]) continue;
+		putc(buf[idx]);
+	}
+}
+
+/* 
+ * write_bench_run
+ *   DESCRIPTION: write write_buf WRITE_REPS times to the scheduled terminal
+ *   INPUTS: batched -- 1 for terminal_write, 0 for the per-byte baseline
+ *   OUTPUTS: the text
+ *   RETURN VALUE: TSC cycles taken
+ *   SIDE EFFECTS: none
+ */
+static uint64_t write_bench_run(int batched) {
+	uint64_t start = rdtsc();
+	uint32_t i;
+	for (i = 0; i < WRITE_REPS; i++) {
+		if (batched)
+			terminal_write(1, write_buf, WRITE_BUF_SIZE);
+		else
+			putc_write(write_buf, WRITE_BUF_SIZE);
+	}
+	return rdtsc() - start;
+}
+
+/* 
+ * terminal_write_bench
+ *   DESCRIPTION: benchmark 7.4.2 - batched terminal_write
+ *                write 64-column lines through terminal_write and through
+ *                putc per byte, on the displayed terminal and on a hidden
+ *                one whose screen is its backup ring
+ *   INPUTS: none
+ *   OUTPUTS: KB/s for each case
+ *   RETURN VALUE: PASS if both paths leave the cursor in the same place
+ *   SIDE EFFECTS: leaves the text on the hidden terminal's screen
+ */
+int terminal_write_bench() {
+	TEST_HEADER;
+	uint32_t khz = tsc_khz;
+	uint32_t kbps[4];
+	int32_t saved_term = cur_term_id;
+	int32_t hidden = (active_term_idx + 1) % MAX_TERMINAL_NUM;
+	int32_t x, y, i;
+	uint32_t bytes = WRITE_BUF_SIZE * WRITE_REPS;
+
+	for (i = 0; i < WRITE_BUF_SIZE; i++)
+		write_buf[i] = ((i + 1) % WRITE_LINE) ? 'a' + i % 26 : '\n';
+
+	cur_term_id = active_term_idx;
+	kbps[0] = bench_kbps(bytes, write_bench_run(1), khz);
+	x = terminals[cur_term_id].cursor_x;
+	y = terminals[cur_term_id].cursor_y;
+	kbps[1] = bench_kbps(bytes, write_bench_run(0), khz);
+
+	cur_term_id = hidden;
+	kbps[2] = bench_kbps(bytes, write_bench_run(1), khz);
+	kbps[3] = bench_kbps(bytes, write_bench_run(0), khz);
+	cur_term_id = saved_term;
+
+	printf("displayed: batched %u KB/s, per byte %u KB/s\n", kbps[0], kbps[1]);
+	printf("hidden: batched %u KB/s, per byte %u KB/s\n", kbps[2], kbps[3]);
+	return (terminals[active_term_idx].cursor_x == x && terminals[active_term_idx].cursor_y == y) ? PASS : FAIL;
+}
+
+#define SWITCH_ROUNDS	256
+
+static uint8_t switch_pages[2][SCREEN_PAGE_SIZE];
+
+/* 
+ * switch_rounds
+ *   DESCRIPTION: switch the display to another terminal and back
+ *                SWITCH_ROUNDS times
+ *   INPUTS: a -- displayed terminal
+ *           b -- other terminal
+ *   OUTPUTS: none
+ *   RETURN VALUE: TSC cycles taken
+ *   SIDE EFFECTS: none
+ */
+static uint64_t switch_rounds(int32_t a, int32_t b) {
+	uint64_t start = rdtsc();
+	uint32_t i;
+	for (i = 0; i < SWITCH_ROUNDS; i++) {
+		switch_terminal(a, b);
+		switch_terminal(b, a);
+	}
+	return rdtsc() - start;
+}
+
+/* 
+ * copy_switch_rounds
+ *   DESCRIPTION: the old screen part of a switch, saving VGA to a backup
+ *                page and restoring another page, there and back
+ *                SWITCH_ROUNDS times; kept here only as the baseline for
+ *                terminal_switch_bench
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: TSC cycles taken
+ *   SIDE EFFECTS: VGA ends up as it started
+ */
+static uint64_t copy_switch_rounds() {
+	uint64_t start = rdtsc();
+	uint32_t i;
+	for (i = 0; i < SWITCH_ROUNDS; i++) {
+		memcpy(switch_pages[0], (void *)VIDEO, SCREEN_PAGE_SIZE);
+		memcpy((void *)VIDEO, switch_pages[1], SCREEN_PAGE_SIZE);
+		memcpy(switch_pages[1], (void *)VIDEO, SCREEN_PAGE_SIZE);
+		memcpy((void *)VIDEO, switch_pages[0], SCREEN_PAGE_SIZE);
+	}
+	return rdtsc() - start;
+}
+
+/* 
+ * terminal_switch_bench
+ *   DESCRIPTION: benchmark 7.4.3 - terminal switch by row difference
+ *                switch between two terminals whose screens are the same,
+ *                then after filling one with other text, and compare with
+ *                copying whole pages through VGA
+ *   INPUTS: none
+ *   OUTPUTS: cycles per switch for each case
+ *   RETURN VALUE: PASS if equal screens cost no VGA rows and the other
+ *                 terminal's text shows up after a switch
+ *   SIDE EFFECTS: leaves text on the other terminal's screen
+ */
+int terminal_switch_bench() {
+	TEST_HEADER;
+	int result = PASS;
+	int32_t a = active_term_idx;
+	int32_t b = (a + 1) % MAX_TERMINAL_NUM;
+	uint64_t same_cycles, diff_cycles, copy_cycles;
+	int32_t i;
+
+	memcpy(screen_page(b), screen_page(a), SCREEN_PAGE_SIZE);
+	terminals[b].top_row = terminals[a].top_row;
+	if (screen_switch(a, b) != 0)
+		result = FAIL;
+	same_cycles = switch_rounds(a, b);
+
+	for (i = 0; i < WRITE_BUF_SIZE; i++)
+		write_buf[i] = ((i + 1) % WRITE_LINE) ? 'A' + i % 26 : '\n';
+	write_screen(b, write_buf, WRITE_BUF_SIZE);
+	diff_cycles = switch_rounds(a, b);
+
+	switch_terminal(a, b);
+	if (*(uint8_t *)(VIDEO + (vga_start << 1)) != 'A' + (WRITE_BUF_SIZE - (NUM_ROWS - 1) * WRITE_LINE) % 26)
+		result = FAIL;
+	switch_terminal(b, a);
+
+	copy_cycles = copy_switch_rounds();
+
+	printf("same screens %u, different %u, page copies %u cycles per switch\n",
+		(uint32_t)div_u64_u32(same_cycles, 2 * SWITCH_ROUNDS, NULL),
+		(uint32_t)div_u64_u32(diff_cycles, 2 * SWITCH_ROUNDS, NULL),
+		(uint32_t)div_u64_u32(copy_cycles, 2 * SWITCH_ROUNDS, NULL));
+	return result;
+}
+
+#define TYPEAHEAD_LINES	4096
+
+/* 
+ * typeahead_bench
+ *   DESCRIPTION: benchmark 7.4.4 - typeahead through the keyboard ring
+ *                queue lines the way the keyboard interrupt does before
+ *                anyone reads, read them back in order, then fill the ring
+ *                until a line is refused and drain it
+ *   INPUTS: none
+ *   OUTPUTS: cycles per queued and per read line
+ *   RETURN VALUE: PASS if every line comes back whole and in order, and a
+ *                 full ring refuses a line without losing the queued ones
+ *   SIDE EFFECTS: none, the ring ends up empty
+ */
+int typeahead_bench() {
+	TEST_HEADER;
+	int result = PASS;
+	terminal_t* term = &terminals[cur_term_id];
+	uint64_t put_cycles = 0, read_cycles = 0, start;
+	uint32_t flags, overruns = term->kb_overruns;
+	int8_t line[KB_BUF_SIZE];
+	char buf[KB_BUF_SIZE];
+	int32_t i, j, len, queued;
+
+	for (i = 0; i < KB_BUF_SIZE; i++)
+		line[i] = 'a' + i % 26;
+	for (i = 0; i < TYPEAHEAD_LINES; i++) {
+		/* lines of 0 to 15 characters, each read right after it is queued */
+		len = i % 16;
+		line[0] = 'a' + i % 26;
+		cli_and_save(flags);
+		start = rdtsc();
+		if (terminal_put_line(cur_term_id, line, len) != 0)
+			result = FAIL;
+		put_cycles += rdtsc() - start;
+		restore_flags(flags);
+
+		start = rdtsc();
+		if (terminal_read(0, buf, KB_BUF_SIZE) != len + 1)
+			result = FAIL;
+		read_cycles += rdtsc() - start;
+		if (buf[len] != '\n' || (len > 0 && buf[0] != 'a' + i % 26))
+			result = FAIL;
+	}
+
+	/* typeahead: queue as many full lines as fit, none may be lost */
+	cli_and_save(flags);
+	for (queued = 0; terminal_put_line(cur_term_id, line, KB_BUF_SIZE - 1) == 0; queued++)
+		;
+	restore_flags(flags);
+	if (queued != KB_RING_SIZE / KB_BUF_SIZE || term->kb_overruns != overruns + 1)
+		result = FAIL;
+	for (i = 0; i < queued; i++) {
+		if (terminal_read(0, buf, KB_BUF_SIZE) != KB_BUF_SIZE)
+			result = FAIL;
+		for (j = 1; j < KB_BUF_SIZE - 1; j++)
+			if (buf[j] != line[j])
+				result = FAIL;
+	}
+	if (term->kb_head != term->kb_tail)
+		result = FAIL;
+
+	printf("queue %u, read %u cycles per line\n",
+		(uint32_t)div_u64_u32(put_cycles, TYPEAHEAD_LINES, NULL),
+		(uint32_t)div_u64_u32(read_cycles, TYPEAHEAD_LINES, NULL));
+	return result;
+}
+
+#define RTC_BENCH_FREQ	64
+#define RTC_OLD_RATE_FREQ	8192	/* rate 3, where rtc_init used to leave it */
+
+/* 
+ * rtc_rate_bench
+ *   DESCRIPTION: benchmark 7.5.1 - adaptive RTC rate
+ *                open two RTCs at different frequencies and check the
+ *                physical rate follows the fastest one, time one second of
+ *                reads at RTC_BENCH_FREQ, then close both
+ *   INPUTS: none
+ *   OUTPUTS: interrupts and handler cycles for that second, and the
+ *            estimate for the old fixed rate
+ *   RETURN VALUE: PASS if the rate follows the open RTCs, one second takes
+ *                 about RTC_BENCH_FREQ interrupts and IRQ 8 ends up masked
+ *   SIDE EFFECTS: none
+ */
+int rtc_rate_bench() {
+	TEST_HEADER;
+	int result = PASS;
+	int32_t fast_fd, slow_fd, i, garbage;
+	int32_t freq;
+	uint32_t irqs;
+	uint64_t cycles;
+
+	if (rtc_stats.open != 0 || rtc_stats.phys_freq != 0)
+		return FAIL;
+	slow_fd = open((uint8_t *)"rtc");
+	if (rtc_stats.phys_freq != 2)
+		result = FAIL;
+	freq = MAX_RTC_FREQ;
+	write(slow_fd, &freq, 4);
+	if (rtc_stats.phys_freq != MAX_RTC_FREQ)
+		result = FAIL;
+	fast_fd = open((uint8_t *)"rtc");
+	freq = RTC_BENCH_FREQ;
+	write(fast_fd, &freq, 4);
+	if (rtc_stats.phys_freq != MAX_RTC_FREQ)
+		result = FAIL;
+	/* the other RTC slows down, the fastest left decides the rate */
+	freq = 2;
+	write(slow_fd, &freq, 4);
+	if (rtc_stats.phys_freq != RTC_BENCH_FREQ)
+		result = FAIL;
+
+	read(fast_fd, &garbage, 4);
+	irqs = rtc_stats.interrupts;
+	cycles = rtc_stats.handler_cycles;
+	for (i = 0; i < RTC_BENCH_FREQ; i++)
+		read(fast_fd, &garbage, 4);
+	irqs = rtc_stats.interrupts - irqs;
+	cycles = rtc_stats.handler_cycles - cycles;
+	if (irqs < RTC_BENCH_FREQ || irqs > RTC_BENCH_FREQ + 1)
+		result = FAIL;
+
+	close(fast_fd);
+	if (rtc_stats.phys_freq != 2)
+		result = FAIL;
+	close(slow_fd);
+	if (rtc_stats.phys_freq != 0 || rtc_stats.open != 0)
+		result = FAIL;
+
+	printf("one second at %u Hz: %u interrupts, %u handler cycles\n",
+		RTC_BENCH_FREQ, irqs, (uint32_t)cycles);
+	printf("fixed %u Hz rate would take %u handler cycles\n", RTC_OLD_RATE_FREQ,
+		irqs ? (uint32_t)div_u64_u32(cycles * RTC_OLD_RATE_FREQ, irqs, NULL) : 0);
+	print_rtc_stats();
+	return result;
+}
+
+#define VRTC_FAST_FREQ	64
+#define VRTC_SLOW_FREQ	8
+#define VRTC_READS		32
+
+/* 
+ * vrtc_timer_bench
+ *   DESCRIPTION: benchmark 7.5.2 - per-descriptor RTC deadlines
+ *                read one RTC VRTC_READS times on time, then let it fall
+ *                behind while blocked on a slower RTC, and read it again
+ *   INPUTS: none
+ *   OUTPUTS: wake-up jitter of each RTC
+ *   RETURN VALUE: PASS if on-time reads land exactly one period apart with
+ *                 nothing missed, and the virtual interrupts that passed
+ *                 during the slow read are counted as missed
+ *   SIDE EFFECTS: none
+ */
+int vrtc_timer_bench() {
+	TEST_HEADER;
+	int result = PASS;
+	int32_t fast_fd, slow_fd, i, garbage;
+	int32_t freq;
+	int start;
+	vrtc_t* fast;
+
+	fast_fd = open((uint8_t *)"rtc");
+	slow_fd = open((uint8_t *)"rtc");
+	if (fast_fd == -1 || slow_fd == -1)
+		return FAIL;
+	fast = file_array[fast_fd].private_data;
+	freq = VRTC_FAST_FREQ;
+	write(fast_fd, &freq, 4);
+	freq = VRTC_SLOW_FREQ;
+	write(slow_fd, &freq, 4);
+
+	/* the first read arms the deadline */
+	read(fast_fd, &garbage, 4);
+	start = rtc_counter_global;
+	for (i = 0; i < VRTC_READS; i++)
+		read(fast_fd, &garbage, 4);
+	if (rtc_counter_global - start != VRTC_READS * (MAX_RTC_FREQ / VRTC_FAST_FREQ))
+		result = FAIL;
+	if (fast->missed != 0)
+		result = FAIL;
+
+	/* the fast RTC keeps ticking while the slow read blocks */
+	read(slow_fd, &garbage, 4);
+	read(fast_fd, &garbage, 4);
+	if (fast->missed < VRTC_FAST_FREQ / VRTC_SLOW_FREQ - 1)
+		result = FAIL;
+
+	print_rtc_stats();
+	close(fast_fd);
+	close(slow_fd);
+	return result;
+}
+
+#define KTIME_LOOPS		100000
+#define SYS_GETTIME		11
+
+/* 
+ * ktime_bench
+ *   DESCRIPTION: benchmark 7.6.1 - monotonic clock
+ *                check the cycle to ns conversion against tsc_khz, read
+ *                the clock back to back, and time the gettime syscall
+ *   INPUTS: none
+ *   OUTPUTS: TSC frequency, cycles per ktime_ns and per gettime trap
+ *   RETURN VALUE: PASS if one second of cycles converts to 1s within 10us,
+ *                 the clock never goes backwards and gettime refuses a
+ *                 kernel address
+ *   SIDE EFFECTS: none
+ */
+int ktime_bench() {
+	TEST_HEADER;
+	int result = PASS;
+	uint64_t now, prev, start, read_cycles, trap_cycles, second;
+	int32_t ret = 0;
+	uint32_t i;
+
+	second = cycles_to_ns((uint64_t)tsc_khz * 1000);
+	if (second < 1000000000ULL - 10000 || second > 1000000000ULL + 10000)
+		result = FAIL;
+
+	prev = ktime_ns();
+	start = rdtsc();
+	for (i = 0; i < KTIME_LOOPS; i++) {
+		now = ktime_ns();
+		if (now < prev)
+			result = FAIL;
+		prev = now;
+	}
+	read_cycles = rdtsc() - start;
+
+	start = rdtsc();
+	for (i = 0; i < KTIME_LOOPS; i++) {
+		asm volatile ("int $0x80"
+			: "=a"(ret)
+			: "a"(SYS_GETTIME), "b"(&now)
+			: "memory", "cc"
+		);
+	}
+	trap_cycles = rdtsc() - start;
+	if (ret != -1)
+		result = FAIL;
+
+	printf("tsc %u kHz, %u us since boot\n", tsc_khz,
+		(uint32_t)div_u64_u32(ktime_ns(), 1000, NULL));
+	printf("ktime_ns %u cycles, gettime trap %u cycles\n",
+		(uint32_t)div_u64_u32(read_cycles, KTIME_LOOPS, NULL),
+		(uint32_t)div_u64_u32(trap_cycles, KTIME_LOOPS, NULL));
+	return result;
+}
+
+/* 
+ * time_page_clock
+ *   DESCRIPTION: what ece391_clock does in user space, reading the kernel's
+ *                copy of the time page
+ *   INPUTS: page -- the time page
+ *   OUTPUTS: none
+ *   RETURN VALUE: nanoseconds since boot
+ *   SIDE EFFECTS: none
+ */
+static uint64_t time_page_clock(volatile time_page_t* page) {
+	uint32_t seq, mult, shift;
+	uint64_t base, cycles;
+
+	do {
+		seq = page->seq;
+		mult = page->tsc_mult;
+		shift = page->tsc_shift;
+		base = page->tsc_base;
+		cycles = rdtsc();
+	} while ((seq & 1) || seq != page->seq);
+	cycles -= base;
+	return (((uint64_t)(uint32_t)cycles * mult) >> shift) +
+		(((uint64_t)(uint32_t)(cycles >> 32) * mult) << (32 - shift));
+}
+
+/* 
+ * time_page_bench
+ *   DESCRIPTION: benchmark 7.6.2 - user time page
+ *                check a new process maps the time page read-only at
+ *                TIME_PAGE_VIRTUAL_ADDR, read the clock the way user code
+ *                does, and compare with ktime_ns
+ *   INPUTS: none
+ *   OUTPUTS: cycles per time page read and per ktime_ns
+ *   RETURN VALUE: PASS if the mapping is user read-only onto the time page,
+ *                 a tick updates the page, and both clocks agree within 1ms
+ *   SIDE EFFECTS: counts one extra tick in the time page
+ */
+int time_page_bench() {
+	TEST_HEADER;
+	int result = PASS;
+	volatile time_page_t* page = (time_page_t*)time_page_frame();
+	page_table_entry_t* table;
+	pcb_t* pcb;
+	uint64_t ticks, start, page_cycles, ktime_cycles, page_ns, now;
+	uint32_t i;
+
+	if ((pcb = alloc_pcb()) == NULL)
+		return FAIL;
+	table = (page_table_entry_t*)(pcb->page_dir[TIME_PAGE_VIRTUAL_ADDR >> SHIFT_4M].page_table_addr << SHIFT_4K);
+	if (!pcb->page_dir[TIME_PAGE_VIRTUAL_ADDR >> SHIFT_4M].present ||
+		!table[TIME_PAGE_INDEX].present || table[TIME_PAGE_INDEX].r_w ||
+		!table[TIME_PAGE_INDEX].u_s ||
+		table[TIME_PAGE_INDEX].page_base_addr != (uint32_t)page >> SHIFT_4K)
+		result = FAIL;
+	free_pcb(pcb);
+
+	ticks = page->ticks;
+	time_page_tick();
+	if (page->ticks != ticks + 1 || (page->seq & 1) || page->tsc_mult != tsc_mult)
+		result = FAIL;
+
+	page_ns = time_page_clock(page);
+	now = ktime_ns();
+	if (now < page_ns || now - page_ns > 1000000)
+		result = FAIL;
+
+	start = rdtsc();
+	for (i = 0; i < KTIME_LOOPS; i++)
+		page_ns = time_page_clock(page);
+	page_cycles = rdtsc() - start;
+	start = rdtsc();
+	for (i = 0; i < KTIME_LOOPS; i++)
+		now = ktime_ns();
+	ktime_cycles = rdtsc() - start;
+
+	printf("time page read %u cycles, ktime_ns %u cycles\n",
+		(uint32_t)div_u64_u32(page_cycles, KTIME_LOOPS, NULL),
+		(uint32_t)div_u64_u32(ktime_cycles, KTIME_LOOPS, NULL));
+	return result;
+}
+
+#define WHEEL_TIMERS	512
+#define WHEEL_SPAN		70000	/* ticks, reaches the second upper level */
+#define SLEEP_MS		50
+
+static ktimer_t wheel_timers[WHEEL_TIMERS];
+static uint32_t wheel_fired_at[WHEEL_TIMERS];
+/* a timer that adds itself again from its callback */
+static ktimer_t rearm_timer;
+static uint32_t rearm_fired_at[3];
+
+/* 
+ * wheel_fired
+ *   DESCRIPTION: timer callback of timer_wheel_bench, records the tick
+ *   INPUTS: data -- index of the timer
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void wheel_fired(uint32_t data) {
+	wheel_fired_at[data] = jiffies;
+}
+
+/* 
+ * wheel_rearm
+ *   DESCRIPTION: timer callback of timer_wheel_bench that adds its own
+ *                timer again: first TVR_SIZE ticks ahead, which is the slot
+ *                being run, then for the tick that is running
+ *   INPUTS: data -- number of times it ran before
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: re-arms rearm_timer twice
+ */
+static void wheel_rearm(uint32_t data) {
+	rearm_fired_at[data] = jiffies;
+	rearm_timer.data = data + 1;
+	if (data == 0)
+		add_timer(&rearm_timer, jiffies + TVR_SIZE);
+	else if (data == 1)
+		add_timer(&rearm_timer, jiffies);
+}
+
+/* 
+ * timer_wheel_bench
+ *   DESCRIPTION: benchmark 7.7.1 - timer wheel
+ *                arm timers spread over WHEEL_SPAN ticks, cancel a quarter,
+ *                and a timer whose callback re-arms it, drive the wheel
+ *                tick by tick, then sleep SLEEP_MS on the real PIT
+ *   INPUTS: none
+ *   OUTPUTS: cycles per add, cancel and tick, and the time slept
+ *   RETURN VALUE: PASS if every timer left runs exactly at its tick, none
+ *                 of the cancelled ones run, the re-armed timer runs
+ *                 TVR_SIZE ticks and then one tick after itself, and sleep
+ *                 lasts at least SLEEP_MS but no more than two ticks longer
+ *   SIDE EFFECTS: none, jiffies is put back after driving the wheel by hand
+ */
+int timer_wheel_bench() {
+	TEST_HEADER;
+	int result = PASS;
+	uint64_t start, add_cycles, del_cycles, tick_cycles, slept;
+	uint32_t base, flags;
+	int32_t i;
+
+	/* the wheel must be empty so it can be reset to the real jiffies */
+	if (timer_stats.pending != 0)
+		return FAIL;
+	cli_and_save(flags);
+	base = jiffies;
+	init_timer(&rearm_timer, wheel_rearm, 0);
+	add_timer(&rearm_timer, base + 1);
+	start = rdtsc();
+	for (i = 0; i < WHEEL_TIMERS; i++) {
+		wheel_fired_at[i] = 0;
+		init_timer(&wheel_timers[i], wheel_fired, i);
+		/* spread the expiries with a multiplicative hash */
+		add_timer(&wheel_timers[i], base + 1 + (i * 2654435761U) % WHEEL_SPAN);
+	}
+	add_cycles = rdtsc() - start;
+	start = rdtsc();
+	for (i = 0; i < WHEEL_TIMERS; i += 4) {
+		if (del_timer(&wheel_timers[i]) != 1)
+			result = FAIL;
+	}
+	del_cycles = rdtsc() - start;
+	start = rdtsc();
+	for (i = 0; i < WHEEL_SPAN; i++)
+		timer_tick();
+	tick_cycles = rdtsc() - start;
+	/* every timer has run: put the clock back where the PIT left it */
+	if (timer_stats.pending != 0)
+		result = FAIL;
+	jiffies = base;
+	timer_init();
+	restore_flags(flags);
+
+	if (rearm_fired_at[0] != base + 1 || rearm_fired_at[1] != base + 1 + TVR_SIZE ||
+		rearm_fired_at[2] != base + 2 + TVR_SIZE)
+		result = FAIL;
+
+	for (i = 0; i < WHEEL_TIMERS; i++) {
+		if (i % 4 == 0 ? wheel_fired_at[i] != 0 : wheel_fired_at[i] != wheel_timers[i].expires)
+			result = FAIL;
+	}
+
+	start = ktime_ns();
+	sleep(SLEEP_MS);
+	slept = ktime_ns() - start;
+	if (slept < SLEEP_MS * 1000000ULL || slept > (SLEEP_MS + 2 * MS_PER_TICK) * 1000000ULL)
+		result = FAIL;
+
+	printf("add %u, cancel %u, tick %u cycles\n",
+		(uint32_t)div_u64_u32(add_cycles, WHEEL_TIMERS, NULL),
+		(uint32_t)div_u64_u32(del_cycles, WHEEL_TIMERS / 4, NULL),
+		(uint32_t)div_u64_u32(tick_cycles, WHEEL_SPAN, NULL));
+	printf("sleep(%u) took %u us\n", SLEEP_MS, (uint32_t)div_u64_u32(slept, 1000, NULL));
+	print_timer_stats();
+	return result;
+}
+
 /* Test suite entry point */
 void launch_tests(){
 	clear();
@@ -645,6 +2248,35 @@ void launch_tests(){
 		6.2.3 - Real-Time Clock Driver:
 				1. rtc_freq_change
 				2. rtc_invalid_freq
+
+		Performance Benchmarks:
+		7.1.1 - File System:
+				1. read_data_bench
+				2. dentry_lookup_bench
+				3. extent_cache_bench
+		7.2.1 - Process:
+				1. exec_latency_bench
+				2. image_cache_bench
+				3. pcb_alloc_bench
+				4. buddy_alloc_bench
+				5. kmalloc_bench
+		7.3.1 - Syscall:
+				1. current_lookup_bench
+				2. context_switch_bench
+				3. tlb_global_bench
+		7.4.1 - Terminal:
+				1. scroll_bench
+				2. terminal_write_bench
+				3. terminal_switch_bench
+				4. typeahead_bench
+		7.5.1 - RTC:
+				1. rtc_rate_bench
+				2. vrtc_timer_bench
+		7.6.1 - Time:
+				1. ktime_bench
+				2. time_page_bench
+		7.7.1 - Timers:
+				1. timer_wheel_bench
 	*/
 	
 	/* TEST_ID is specified at the LINE 47 */
@@ -778,4 +2410,104 @@ void launch_tests(){
 	#if (TEST_ID == 6232)
 		TEST_OUTPUT("rtc_invalid_freq", rtc_invalid_freq());
 	#endif
+
+	/* TEST_ID 7111 for read_data_bench */
+	#if (TEST_ID == 7111)
+		TEST_OUTPUT("read_data_bench", read_data_bench());
+	#endif
+
+	/* TEST_ID 7112 for dentry_lookup_bench */
+	#if (TEST_ID == 7112)
+		TEST_OUTPUT("dentry_lookup_bench", dentry_lookup_bench());
+	#endif
+
+	/* TEST_ID 7113 for extent_cache_bench */
+	#if (TEST_ID == 7113)
+		TEST_OUTPUT("extent_cache_bench", extent_cache_bench());
+	#endif
+
+	/* TEST_ID 7211 for exec_latency_bench */
+	#if (TEST_ID == 7211)
+		TEST_OUTPUT("exec_latency_bench", exec_latency_bench());
+	#endif
+
+	/* TEST_ID 7212 for image_cache_bench */
+	#if (TEST_ID == 7212)
+		TEST_OUTPUT("image_cache_bench", image_cache_bench());
+	#endif
+
+	/* TEST_ID 7213 for pcb_alloc_bench */
+	#if (TEST_ID == 7213)
+		TEST_OUTPUT("pcb_alloc_bench", pcb_alloc_bench());
+	#endif
+
+	/* TEST_ID 7214 for buddy_alloc_bench */
+	#if (TEST_ID == 7214)
+		TEST_OUTPUT("buddy_alloc_bench", buddy_alloc_bench());
+	#endif
+
+	/* TEST_ID 7215 for kmalloc_bench */
+	#if (TEST_ID == 7215)
+		TEST_OUTPUT("kmalloc_bench", kmalloc_bench());
+	#endif
+
+	/* TEST_ID 7311 for current_lookup_bench */
+	#if (TEST_ID == 7311)
+		TEST_OUTPUT("current_lookup_bench", current_lookup_bench());
+	#endif
+
+	/* TEST_ID 7312 for context_switch_bench */
+	#if (TEST_ID == 7312)
+		TEST_OUTPUT("context_switch_bench", context_switch_bench());
+	#endif
+
+	/* TEST_ID 7313 for tlb_global_bench */
+	#if (TEST_ID == 7313)
+		TEST_OUTPUT("tlb_global_bench", tlb_global_bench());
+	#endif
+
+	/* TEST_ID 7411 for scroll_bench */
+	#if (TEST_ID == 7411)
+		TEST_OUTPUT("scroll_bench", scroll_bench());
+	#endif
+
+	/* TEST_ID 7412 for terminal_write_bench */
+	#if (TEST_ID == 7412)
+		TEST_OUTPUT("terminal_write_bench", terminal_write_bench());
+	#endif
+
+	/* TEST_ID 7413 for terminal_switch_bench */
+	#if (TEST_ID == 7413)
+		TEST_OUTPUT("terminal_switch_bench", terminal_switch_bench());
+	#endif
+
+	/* TEST_ID 7414 for typeahead_bench */
+	#if (TEST_ID == 7414)
+		TEST_OUTPUT("typeahead_bench", typeahead_bench());
+	#endif
+
+	/* TEST_ID 7511 for rtc_rate_bench */
+	#if (TEST_ID == 7511)
+		TEST_OUTPUT("rtc_rate_bench", rtc_rate_bench());
+	#endif
+
+	/* TEST_ID 7512 for vrtc_timer_bench */
+	#if (TEST_ID == 7512)
+		TEST_OUTPUT("vrtc_timer_bench", vrtc_timer_bench());
+	#endif
+
+	/* TEST_ID 7611 for ktime_bench */
+	#if (TEST_ID == 7611)
+		TEST_OUTPUT("ktime_bench", ktime_bench());
+	#endif
+
+	/* TEST_ID 7612 for time_page_bench */
+	#if (TEST_ID == 7612)
+		TEST_OUTPUT("time_page_bench", time_page_bench());
+	#endif
+
+	/* TEST_ID 7711 for timer_wheel_bench */
+	#if (TEST_ID == 7711)
+		TEST_OUTPUT("timer_wheel_bench", timer_wheel_bench());
+	#endif
 }
@@ -0,0 +1,286 @@
+#include "timer.h"
+#include "lib.h"
+#include "waitqueue.h"
+
+volatile uint32_t jiffies = 0;
+/* next tick whose slot timer_tick has to run */
+static uint32_t timer_jiffies;
+/* level 0, one slot per tick */
+static ktimer_t* tv1[TVR_SIZE];
+/* levels 1 to TVN_LEVELS, each slot TVN_SIZE times wider than below */
+static ktimer_t* tvn[TVN_LEVELS][TVN_SIZE];
+
+/* a process blocked in sleep */
+typedef struct sleeper {
+    ktimer_t timer;
+    wait_queue_t wait;
+    volatile int32_t done;
+} sleeper_t;
+
+/* 
+ * timer_init
+ *   DESCRIPTION: empty the timer wheel, called in boot time
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void timer_init() {
+    memset(tv1, 0, sizeof(tv1));
+    memset(tvn, 0, sizeof(tvn));
+    timer_jiffies = jiffies;
+}
+
+/* 
+ * init_timer
+ *   DESCRIPTION: set up a timer that is not pending
+ *   INPUTS: timer -- the timer
+ *           func -- called with data from the PIT interrupt when it expires
+ *           data -- argument for func
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void init_timer(ktimer_t* timer, void (*func)(uint32_t data), uint32_t data) {
+    timer->func = func;
+    timer->data = data;
+    timer->next = NULL;
+    timer->pprev = NULL;
+}
+
+/* 
+ * timer_slot
+ *   DESCRIPTION: find the slot a timer belongs in: level 0 if it expires
+ *                within TVR_SIZE ticks, otherwise the level whose slots
+ *                are just wide enough
+ *   INPUTS: expires -- tick the timer runs at
+ *   OUTPUTS: none
+ *   RETURN VALUE: head of the slot's list
+ *   SIDE EFFECTS: none
+ */
+static ktimer_t** timer_slot(uint32_t expires) {
+    uint32_t idx = expires - timer_jiffies;
+    int32_t level;
+
+    /* already due, run it on the next tick */
+    if ((int32_t)idx < 0)
+        return &tv1[timer_jiffies & TVR_MASK];
+    if (idx < TVR_SIZE)
+        return &tv1[expires & TVR_MASK];
+    for (level = 0; level < TVN_LEVELS - 1; level++) {
+        if (idx < 1U << (TVR_BITS + (level + 1) * TVN_BITS))
+            break;
+    }
+    return &tvn[level][(expires >> (TVR_BITS + level * TVN_BITS)) & TVN_MASK];
+}
+
+/* 
+ * timer_link
+ *   DESCRIPTION: put a timer at the head of the slot for its expiry
+ *   INPUTS: timer -- a timer that is not pending
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void timer_link(ktimer_t* timer) {
+    ktimer_t** slot = timer_slot(timer->expires);
+    timer->next = *slot;
+    if (*slot)
+        (*slot)->pprev = &timer->next;
+    *slot = timer;
+    timer->pprev = slot;
+}
+
+/* 
+ * timer_unlink
+ *   DESCRIPTION: take a pending timer out of its slot
+ *   INPUTS: timer -- a pending timer
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void timer_unlink(ktimer_t* timer) {
+    *timer->pprev = timer->next;
+    if (timer->next)
+        timer->next->pprev = timer->pprev;
+    timer->next = NULL;
+    timer->pprev = NULL;
+}
+
+/* 
+ * add_timer
+ *   DESCRIPTION: arm a timer in O(1), moving it if it was already pending
+ *   INPUTS: timer -- a timer from init_timer
+ *           expires -- tick to run it at, e.g. jiffies + ms_to_ticks(ms)
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: func runs from the PIT interrupt once jiffies reaches expires
+ */
+void add_timer(ktimer_t* timer, uint32_t expires) {
+    uint32_t flags;
+    cli_and_save(flags);
+    if (timer->pprev)
+        timer_unlink(timer);
+    else
+        timer_stats.pending++;
+    timer->expires = expires;
+    timer_link(timer);
+    timer_stats.added++;
+    restore_flags(flags);
+}
+
+/* 
+ * del_timer
+ *   DESCRIPTION: cancel a timer in O(1)
+ *   INPUTS: timer -- a timer from init_timer
+ *   OUTPUTS: none
+ *   RETURN VALUE: 1 if the timer was pending, 0 if it had run or was never added
+ *   SIDE EFFECTS: none
+ */
+int32_t del_timer(ktimer_t* timer) {
+    uint32_t flags;
+    int32_t pending = 0;
+    cli_and_save(flags);
+    if (timer->pprev) {
+        timer_unlink(timer);
+        timer_stats.pending--;
+        timer_stats.cancelled++;
+        pending = 1;
+    }
+    restore_flags(flags);
+    return pending;
+}
+
+/* 
+ * cascade
+ *   DESCRIPTION: spread the timers of one slot of a level over the level
+ *                below, now that their expiries are near enough
+ *   INPUTS: level -- index into tvn
+ *   OUTPUTS: none
+ *   RETURN VALUE: the slot index, 0 means the level above is due too
+ *   SIDE EFFECTS: none
+ */
+static uint32_t cascade(int32_t level) {
+    uint32_t index = (timer_jiffies >> (TVR_BITS + level * TVN_BITS)) & TVN_MASK;
+    ktimer_t* timer = tvn[level][index];
+    ktimer_t* next;
+
+    tvn[level][index] = NULL;
+    while (timer) {
+        next = timer->next;
+        timer_link(timer);
+        timer_stats.cascaded++;
+        timer = next;
+    }
+    return index;
+}
+
+/* 
+ * timer_tick
+ *   DESCRIPTION: advance jiffies and run every timer that expires at the
+ *                new tick, called by pit_handler with interrupts off
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: runs timer callbacks, which may add timers again
+ */
+void timer_tick() {
+    ktimer_t* list;
+    ktimer_t* timer;
+    uint32_t index;
+    int32_t level;
+
+    jiffies++;
+    while ((int32_t)(jiffies - timer_jiffies) >= 0) {
+        index = timer_jiffies & TVR_MASK;
+        /* level 0 wrapped: refill it from the next level, and so on up */
+        if (index == 0) {
+            for (level = 0; level < TVN_LEVELS; level++) {
+                if (cascade(level) != 0)
+                    break;
+            }
+        }
+        timer_jiffies++;
+        /* detach the slot first: a callback may add a timer that lands in
+         * this same slot (TVR_SIZE ticks ahead, or already due), which must
+         * wait for its own turn. Timers still on the detached list stay
+         * pending, so callbacks can cancel them through pprev */
+        list = tv1[index];
+        tv1[index] = NULL;
+        if (list)
+            list->pprev = &list;
+        while ((timer = list) != NULL) {
+            timer_unlink(timer);
+            timer_stats.pending--;
+            timer_stats.expired++;
+            timer->func(timer->data);
+        }
+    }
+}
+
+/* 
+ * ms_to_ticks
+ *   DESCRIPTION: convert a timeout to ticks, rounding up and counting the
+ *                tick already in progress, so the wait is never shorter
+ *   INPUTS: ms -- milliseconds
+ *   OUTPUTS: none
+ *   RETURN VALUE: ticks to add to jiffies
+ *   SIDE EFFECTS: none
+ */
+uint32_t ms_to_ticks(uint32_t ms) {
+    return ms / MS_PER_TICK + (ms % MS_PER_TICK != 0) + 1;
+}
+
+/* 
+ * print_timer_stats
+ *   DESCRIPTION: print the timer wheel counters
+ *   INPUTS: none
+ *   OUTPUTS: counters to the screen
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void print_timer_stats() {
+    printf("timers: %u pending, %u added, %u expired, %u cancelled, %u cascaded\n",
+        timer_stats.pending, timer_stats.added, timer_stats.expired,
+        timer_stats.cancelled, timer_stats.cascaded);
+}
+
+/* 
+ * sleep_timeout
+ *   DESCRIPTION: timer callback of sleep, wakes the sleeper
+ *   INPUTS: data -- the sleeper_t
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void sleep_timeout(uint32_t data) {
+    sleeper_t* sleeper = (sleeper_t*)data;
+    sleeper->done = 1;
+    wake_up(&sleeper->wait);
+}
+
+/* 
+ * sleep
+ *   DESCRIPTION: syscall that blocks the caller for at least ms
+ *                milliseconds, giving the CPU to other processes
+ *   INPUTS: ms -- milliseconds to sleep, 0 returns at once
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0
+ *   SIDE EFFECTS: none
+ */
+int32_t sleep(uint32_t ms) {
+    /* on the kernel stack, which stays put while the caller is blocked */
+    sleeper_t sleeper;
+    uint32_t flags;
+
+    if (ms == 0)
+        return 0;
+    init_wait_queue(&sleeper.wait);
+    sleeper.done = 0;
+    init_timer(&sleeper.timer, sleep_timeout, (uint32_t)&sleeper);
+    cli_and_save(flags);
+    add_timer(&sleeper.timer, jiffies + ms_to_ticks(ms));
+    wait_event(&sleeper.wait, sleeper.done);
+    restore_flags(flags);
+    return 0;
+}
@@ -0,0 +1,64 @@
+#ifndef _TIMER_H
+#define _TIMER_H
+
+#include "types.h"
+
+/* PIT ticks per second, as programmed by pit_init */
+#define TIMER_HZ        100
+#define MS_PER_TICK     (1000 / TIMER_HZ)
+
+/* hierarchical timer wheel: 256 one-tick slots, then four levels of 64
+   slots each 64 times coarser, which together cover every 32-bit expiry */
+#define TVR_BITS        8
+#define TVN_BITS        6
+#define TVR_SIZE        (1 << TVR_BITS)
+#define TVN_SIZE        (1 << TVN_BITS)
+#define TVR_MASK        (TVR_SIZE - 1)
+#define TVN_MASK        (TVN_SIZE - 1)
+#define TVN_LEVELS      4
+
+/* a callback to run at a given tick */
+typedef struct ktimer {
+    /* tick (jiffies value) the timer runs at */
+    uint32_t expires;
+    void (*func)(uint32_t data);
+    uint32_t data;
+    /* slot list links, pprev is NULL while the timer is not pending */
+    struct ktimer* next;
+    struct ktimer** pprev;
+} ktimer_t;
+
+/* timer wheel counters */
+typedef struct timer_stats {
+    uint32_t added;
+    uint32_t expired;
+    uint32_t cancelled;
+    /* timers moved down a level */
+    uint32_t cascaded;
+    uint32_t pending;
+} timer_stats_t;
+
+timer_stats_t timer_stats;
+
+/* PIT ticks since boot */
+extern volatile uint32_t jiffies;
+
+/* empty the wheel, called at boot */
+void timer_init();
+/* set up a timer that is not pending */
+void init_timer(ktimer_t* timer, void (*func)(uint32_t data), uint32_t data);
+/* run timer->func at tick expires, re-arming a pending timer */
+void add_timer(ktimer_t* timer, uint32_t expires);
+/* stop a timer, returns 1 if it was pending */
+int32_t del_timer(ktimer_t* timer);
+/* advance one tick and run the timers due, called by pit_handler */
+void timer_tick();
+/* ticks that cover at least ms milliseconds from now */
+uint32_t ms_to_ticks(uint32_t ms);
+/* print the timer wheel counters */
+void print_timer_stats();
+
+/* syscall: block the caller for at least ms milliseconds */
+extern int32_t sleep(uint32_t ms);
+
+#endif
@@ -0,0 +1,58 @@
+#include "waitqueue.h"
+#include "process.h"
+#include "scheduling.h"
+
+/* 
+ * init_wait_queue
+ *   DESCRIPTION: empty a wait queue
+ *   INPUTS: wq -- queue to initialize
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void init_wait_queue(wait_queue_t* wq) {
+    wq->head = NULL;
+}
+
+/* 
+ * sleep_on
+ *   DESCRIPTION: take the current process off the run queue, queue it on wq and give
+ *                the cpu to another runnable process. Returns once a
+ *                wake_up has made it runnable and it has been scheduled again.
+ *                With no process running yet (kernel tests) it just halts
+ *                until the next interrupt
+ *   INPUTS: wq -- queue to sleep on
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: must be called with interrupts off; they are off again on return
+ */
+void sleep_on(wait_queue_t* wq) {
+    if (!prog_counter) {
+        asm volatile ("sti; hlt; cli" : : : "memory");
+        return;
+    }
+    pcb_t* pcb = current;
+    runqueue_remove(pcb);
+    pcb->wait_next = wq->head;
+    wq->head = pcb;
+    schedule();
+}
+
+/* 
+ * wake_up
+ *   DESCRIPTION: put every process sleeping on wq back on the run queue. They
+ *                do not run right away, the scheduler picks them up on its next pass
+ *   INPUTS: wq -- queue to wake
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: wq is emptied
+ */
+void wake_up(wait_queue_t* wq) {
+    uint32_t flags;
+    pcb_t* pcb;
+    cli_and_save(flags);
+    for (pcb = wq->head; pcb != NULL; pcb = pcb->wait_next)
+        runqueue_add(pcb);
+    wq->head = NULL;
+    restore_flags(flags);
+}
@@ -0,0 +1,32 @@
+#ifndef _WAITQUEUE_H
+#define _WAITQUEUE_H
+
+#include "types.h"
+#include "lib.h"
+
+struct pcb;
+
+/* processes sleeping on one event, linked through pcb->wait_next */
+typedef struct wait_queue {
+    struct pcb* head;
+} wait_queue_t;
+
+/* empty a wait queue */
+void init_wait_queue(wait_queue_t* wq);
+/* block the current process on wq until wake_up, interrupts must be off */
+void sleep_on(wait_queue_t* wq);
+/* make every process sleeping on wq runnable again */
+void wake_up(wait_queue_t* wq);
+
+/* sleep on wq until cond holds; cond is checked with interrupts off so a
+ * wake_up from an interrupt handler cannot slip in between check and sleep */
+#define wait_event(wq, cond)                \
+do {                                        \
+    uint32_t __wait_flags;                  \
+    cli_and_save(__wait_flags);             \
+    while (!(cond))                         \
+        sleep_on(wq);                       \
+    restore_flags(__wait_flags);            \
+} while (0)
+
+#endif
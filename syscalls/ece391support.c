@@ -102,3 +102,25 @@ uint8_t* ece391_strrev(uint8_t* s)
    return s;
 }
 
+/* Nanoseconds since boot, read from the kernel's time page: a few loads
+ * and rdtsc, no system call. Retry while the kernel is updating it. */
+uint64_t ece391_clock(void)
+{
+    volatile struct ece391_time_page* page =
+        (volatile struct ece391_time_page*)ECE391_TIME_PAGE;
+    uint32_t seq, mult, shift, low, high;
+    uint64_t base, cycles;
+
+    do {
+        seq = page->seq;
+        mult = page->tsc_mult;
+        shift = page->tsc_shift;
+        base = page->tsc_base;
+        asm volatile ("rdtsc" : "=a"(low), "=d"(high));
+    } while ((seq & 1) || seq != page->seq);
+
+    cycles = (((uint64_t)high << 32) | low) - base;
+    /* the 96-bit product in two halves */
+    return ((((uint64_t)(uint32_t)cycles) * mult) >> shift) +
+           ((((uint64_t)(uint32_t)(cycles >> 32)) * mult) << (32 - shift));
+}
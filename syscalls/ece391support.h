@@ -9,5 +9,28 @@ extern int32_t ece391_strncmp(const uint8_t* s1, const uint8_t* s2, uint32_t n);
 extern uint8_t *ece391_itoa(uint32_t value, uint8_t* buf, int32_t radix);
 extern uint8_t *ece391_strrev(uint8_t* s);
 
+/* read-only page the kernel maps in every program, see ece391_clock */
+#define ECE391_TIME_PAGE 0x08401000
+
+struct ece391_time_page {
+    /* odd while the kernel updates the page */
+    volatile uint32_t seq;
+    /* ns since boot = ((rdtsc - tsc_base) * tsc_mult) >> tsc_shift */
+    uint32_t tsc_khz;
+    uint32_t tsc_mult;
+    uint32_t tsc_shift;
+    uint64_t tsc_base;
+    /* timer ticks since boot, their rate, and the ns at the last one */
+    uint64_t ticks;
+    uint32_t tick_hz;
+    uint64_t tick_ns;
+    /* process switches since boot and running processes */
+    uint32_t switches;
+    uint32_t running;
+};
+
+/* nanoseconds since boot, read from the time page without a system call */
+extern uint64_t ece391_clock (void);
+
 #endif /* ECE391SUPPORT_H */
 
@@ -21,6 +21,10 @@ extern int32_t ece391_getargs (uint8_t* buf, int32_t nbytes);
 extern int32_t ece391_vidmap (uint8_t** screen_start);
 extern int32_t ece391_set_handler (int32_t signum, void* handler);
 extern int32_t ece391_sigreturn (void);
+/* nanoseconds since boot */
+extern int32_t ece391_gettime (uint64_t* ns);
+/* block for at least ms milliseconds */
+extern int32_t ece391_sleep (uint32_t ms);
 
 enum signums {
 	DIV_ZERO = 0,